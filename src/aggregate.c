@@ -0,0 +1,527 @@
+/* 
+   tlve - A program to parse tag-length-value structures and print them in different formats
+
+   Copyright (C) 2009 Timo Savinen
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.  
+*/ 
+#include "tlve.h"
+
+/* Group-by aggregation, options --record, --group-by and --aggregate.
+
+   Record is a constructed element given by name. Key elements and aggregated
+   elements are searched inside the record. When the record ends, its values are
+   added to a group in a hash table keyed by the raw octets of the key values.
+   The groups are printed at the end as tab separated table.
+
+   Definitions are resolved at start, elements are matched using the index of
+   their tlv definition.
+ */
+
+#define MAX_KEYS 16
+#define MAX_AGGREGATES 32
+
+/* aggregate functions */
+#define A_COUNT 0            // count of records, or count of elements if element is given
+#define A_SUM 1
+#define A_MIN 2
+#define A_MAX 3
+
+static char *function_names[] = {"count","sum","min","max",NULL};
+
+/* value of one aggregate */
+struct agg_value
+{
+    FILE_OFFSET count;       // values added
+    long long int isum;      // integer values are summed here
+    double dsum;             // other numeric values
+    double min;
+    double max;
+    int is_float;            // some value was not an integer
+};
+
+struct aggregate
+{
+    int function;            // A_*
+    char *name;              // element name, NULL for count of records
+    char *title;             // column title as given by user
+};
+
+/* one group in hash table */
+struct group
+{
+    BUFFER *key;             // raw key, key values prefixed by their length
+    size_t key_len;
+    size_t hash;
+    char **key_text;         // converted key values for printing
+    FILE_OFFSET records;
+    struct agg_value *values;
+    struct group *next;
+};
+
+/* key or aggregate value collected from the current record */
+struct record_key
+{
+    BUFFER *raw;
+    size_t raw_len;
+    size_t raw_size;
+    char *text;
+    size_t text_size;
+    int found;
+};
+
+TLS int aggregating = 0;
+
+static TLS char *record_name = NULL;
+static TLS char *key_names[MAX_KEYS];
+static TLS int key_count = 0;
+static TLS struct aggregate aggregates[MAX_AGGREGATES];
+static TLS int aggregate_count = 0;
+
+/* roles of tlv definitions, indexed by definition index */
+static TLS int *is_record = NULL;
+static TLS int *key_of = NULL;                  // key number or -1
+static TLS unsigned int *aggs_of = NULL;        // bit mask of aggregates using the definition
+
+/* current record */
+static TLS int record_level = 0;               // 0 = not in record
+static TLS struct record_key record_keys[MAX_KEYS];
+static TLS struct agg_value record_values[MAX_AGGREGATES];
+
+/* group hash table */
+static TLS struct group **groups = NULL;
+static TLS size_t group_table_size = 0;
+static TLS size_t group_count = 0;
+static TLS BUFFER *key_buffer = NULL;
+static TLS size_t key_buffer_size = 0;
+
+/* split comma separated list to items, list is modified */
+static int
+split_list(char *list,char **items,int max,char *what)
+{
+    char *p;
+    int count = 0;
+
+    for(p = strtok(list,",");p != NULL;p = strtok(NULL,","))
+    {
+        if(count == max) panic("Too many items in list",what,NULL);
+        items[count++] = p;
+    }
+    return count;
+}
+
+void
+aggregate_set_record(char *name)
+{
+    record_name = xstrdup(name);
+    aggregating = 1;
+}
+
+void
+aggregate_set_keys(char *names)
+{
+    key_count = split_list(xstrdup(names),key_names,MAX_KEYS,"--group-by");
+    aggregating = 1;
+}
+
+/* parse aggregate list like count,sum(AdvisedCharge),max(AdvisedCharge) */
+void
+aggregate_set_functions(char *list)
+{
+    char *items[MAX_AGGREGATES];
+    char *p,*e;
+    int i,j,count;
+
+    count = split_list(xstrdup(list),items,MAX_AGGREGATES - aggregate_count,"--aggregate");
+
+    for(i = 0;i < count;i++)
+    {
+        struct aggregate *a = &aggregates[aggregate_count++];
+
+        a->title = items[i];
+        a->name = NULL;
+        p = strchr(items[i],'(');
+        if(p != NULL)
+        {
+            e = strchr(p,')');
+            if(e == NULL || e[1]) panic("Missing ) in aggregate function",items[i],NULL);
+            a->name = xmalloc(e - p);
+            memcpy(a->name,p + 1,e - p - 1);
+            a->name[e - p - 1] = 0;
+            a->title = xstrdup(items[i]);
+            *p = 0;
+        }
+
+        for(j = 0;function_names[j] != NULL;j++) if(STRCMP(items[i],function_names[j]) == 0) break;
+        if(function_names[j] == NULL) panic("Unknown aggregate function",items[i],NULL);
+        a->function = j;
+        if(a->function != A_COUNT && a->name == NULL) panic("Aggregate function needs an element name",items[i],NULL);
+    }
+    aggregating = 1;
+}
+
+/* mark definitions having name, return the count of found definitions */
+static int
+resolve_name(char *name,int *flags,int value)
+{
+    struct tlvlist *l;
+    int found = 0;
+
+    for(l = structure.tlv;l != NULL;l = l->next)
+    {
+        if(l->tlv->name != NULL && STRCMP(l->tlv->name,name) == 0)
+        {
+            flags[l->tlv->index] = value;
+            found++;
+        }
+    }
+    if(!found) panic("Name not found in tlv names",name,NULL);
+    return found;
+}
+
+/* resolve the names, called after the configuration is read */
+void
+aggregate_init()
+{
+    struct tlvlist *l;
+    int tlv_count = 0,i,*flags;
+
+    if(!aggregating) return;
+
+    if(record_name == NULL) panic("Record element must be given with --record",NULL,NULL);
+    if(!aggregate_count) aggregate_set_functions("count");
+
+    for(l = structure.tlv;l != NULL;l = l->next) tlv_count++;
+
+    is_record = xcalloc((size_t) tlv_count + 1,sizeof(int));
+    key_of = xmalloc(sizeof(int) * (tlv_count + 1));
+    aggs_of = xcalloc((size_t) tlv_count + 1,sizeof(unsigned int));
+    flags = xmalloc(sizeof(int) * (tlv_count + 1));
+
+    for(i = 0;i <= tlv_count;i++) key_of[i] = -1;
+
+    resolve_name(record_name,is_record,1);
+    for(i = 0;i < key_count;i++) resolve_name(key_names[i],key_of,i);
+
+    for(i = 0;i < aggregate_count;i++)
+    {
+        int j;
+
+        if(aggregates[i].name == NULL) continue;
+        memset(flags,0,sizeof(int) * (tlv_count + 1));
+        resolve_name(aggregates[i].name,flags,1);
+        for(j = 0;j < tlv_count;j++) if(flags[j]) aggs_of[j] |= 1U << i;
+    }
+    free(flags);
+
+    group_table_size = 1024;
+    groups = xcalloc(group_table_size,sizeof(struct group *));
+}
+
+static void
+value_clear(struct agg_value *v)
+{
+    v->count = 0;
+    v->isum = 0;
+    v->dsum = 0;
+    v->is_float = 0;
+}
+
+/* add value of element to v */
+static void
+value_add(struct agg_value *v,struct tlvitem *item)
+{
+    long long int i;
+    double d;
+
+    if(item_int_value(item,&i))
+    {
+        v->isum += i;
+        d = (double) i;
+    } else
+    {
+        convert_value(item);
+        d = strtod(item->converted_value,NULL);
+        if(d == (double) (long long int) d)
+        {
+            v->isum += (long long int) d;
+        } else
+        {
+            v->dsum += d;
+            v->is_float = 1;
+        }
+    }
+    if(!v->count || d < v->min) v->min = d;
+    if(!v->count || d > v->max) v->max = d;
+    v->count++;
+}
+
+/* merge record value r to group value v */
+static void
+value_merge(struct agg_value *v,struct agg_value *r)
+{
+    if(!r->count) return;
+    if(!v->count || r->min < v->min) v->min = r->min;
+    if(!v->count || r->max > v->max) v->max = r->max;
+    v->count += r->count;
+    v->isum += r->isum;
+    v->dsum += r->dsum;
+    v->is_float |= r->is_float;
+}
+
+static void
+record_start(int level)
+{
+    int i;
+
+    record_level = level;
+    for(i = 0;i < key_count;i++) record_keys[i].found = 0;
+    for(i = 0;i < aggregate_count;i++) value_clear(&record_values[i]);
+}
+
+/* save the key value of the current record */
+static void
+record_key(struct record_key *k,struct tlvitem *item)
+{
+    size_t len;
+
+    if(k->found) return;        // first one is used
+    k->found = 1;
+
+    if(item->value_length > k->raw_size)
+    {
+        k->raw_size = item->value_length;
+        k->raw = xrealloc(k->raw,k->raw_size);
+    }
+    memcpy(k->raw,item->raw_value,item->value_length);
+    k->raw_len = item->value_length;
+
+    convert_value(item);
+    len = strlen(item->converted_value) + 1;
+    if(len > k->text_size)
+    {
+        k->text_size = len;
+        k->text = xrealloc(k->text,k->text_size);
+    }
+    memcpy(k->text,item->converted_value,len);
+}
+
+/* FNV-1a */
+static size_t
+key_hash(BUFFER *key,size_t len)
+{
+    size_t h = (size_t) 2166136261U;
+
+    while(len--) h = (h ^ *key++) * (size_t) 16777619U;
+    return h;
+}
+
+static void
+grow_groups()
+{
+    struct group **old = groups,*g,*next;
+    size_t old_size = group_table_size,i;
+
+    group_table_size *= 2;
+    groups = xcalloc(group_table_size,sizeof(struct group *));
+
+    for(i = 0;i < old_size;i++)
+    {
+        for(g = old[i];g != NULL;g = next)
+        {
+            next = g->next;
+            g->next = groups[g->hash & (group_table_size - 1)];
+            groups[g->hash & (group_table_size - 1)] = g;
+        }
+    }
+    free(old);
+}
+
+/* add the current record to its group */
+static void
+record_end()
+{
+    size_t len = 0,h,i;
+    struct group *g;
+    int k;
+
+    record_level = 0;
+
+    for(k = 0;k < key_count;k++) len += sizeof(size_t) + (record_keys[k].found ? record_keys[k].raw_len : 0);
+    if(len > key_buffer_size)
+    {
+        key_buffer_size = 2 * len;
+        key_buffer = xrealloc(key_buffer,key_buffer_size);
+    }
+
+    len = 0;
+    for(k = 0;k < key_count;k++)
+    {
+        size_t klen = record_keys[k].found ? record_keys[k].raw_len : (size_t) -1;     // missing key differs from empty
+
+        memcpy(key_buffer + len,&klen,sizeof(size_t));
+        len += sizeof(size_t);
+        if(record_keys[k].found)
+        {
+            memcpy(key_buffer + len,record_keys[k].raw,record_keys[k].raw_len);
+            len += record_keys[k].raw_len;
+        }
+    }
+
+    h = key_hash(key_buffer,len);
+
+    for(g = groups[h & (group_table_size - 1)];g != NULL;g = g->next)
+    {
+        if(g->hash == h && g->key_len == len && memcmp(g->key,key_buffer,len) == 0) break;
+    }
+
+    if(g == NULL)
+    {
+        g = xmalloc(sizeof(struct group));
+        g->key = xmalloc(len + 1);
+        memcpy(g->key,key_buffer,len);
+        g->key_len = len;
+        g->hash = h;
+        g->key_text = xmalloc(sizeof(char *) * (key_count + 1));
+        for(k = 0;k < key_count;k++) g->key_text[k] = xstrdup(record_keys[k].found ? record_keys[k].text : "");
+        g->records = 0;
+        g->values = xmalloc(sizeof(struct agg_value) * (aggregate_count + 1));
+        for(i = 0;i < (size_t) aggregate_count;i++) value_clear(&g->values[i]);
+        g->next = groups[h & (group_table_size - 1)];
+        groups[h & (group_table_size - 1)] = g;
+        if(++group_count > group_table_size) grow_groups();
+    }
+
+    g->records++;
+    for(i = 0;i < (size_t) aggregate_count;i++) value_merge(&g->values[i],&record_values[i]);
+}
+
+/* element has been parsed */
+void
+aggregate_item(struct tlvitem *item)
+{
+    unsigned int mask;
+    int i;
+
+    if(item->tlv == NULL) return;
+
+    if(!record_level)
+    {
+        if(item->tlv_type == T_CONSTRUCTED && is_record[item->tlv->index]) record_start(item->level);
+        return;
+    }
+
+    if(item->tlv_type == T_CONSTRUCTED) return;
+
+    if(key_of[item->tlv->index] >= 0) record_key(&record_keys[key_of[item->tlv->index]],item);
+
+    mask = aggs_of[item->tlv->index];
+    for(i = 0;mask;i++,mask >>= 1)
+    {
+        if(mask & 1) value_add(&record_values[i],item);
+    }
+}
+
+/* current level after an element, record ends when its level has been left */
+void
+aggregate_level(int level)
+{
+    if(record_level && level <= record_level) record_end();
+}
+
+/* sort by key values */
+static int
+compare_groups(const void *a,const void *b)
+{
+    struct group *ga = *(struct group **) a,*gb = *(struct group **) b;
+    int k,r;
+
+    for(k = 0;k < key_count;k++)
+    {
+        r = strcmp(ga->key_text[k],gb->key_text[k]);
+        if(r) return r;
+    }
+    return 0;
+}
+
+static void
+print_value(FILE *fp,struct aggregate *a,struct group *g,struct agg_value *v)
+{
+    double d;
+
+    switch(a->function)
+    {
+        case A_COUNT:
+            fprintf(fp,"%lld",(long long) (a->name == NULL ? g->records : v->count));
+            return;
+        case A_SUM:
+            if(v->is_float)
+            {
+                fprintf(fp,"%.15g",(double) v->isum + v->dsum);
+            } else
+            {
+                fprintf(fp,"%lld",v->isum);
+            }
+            return;
+        case A_MIN:
+            d = v->min;
+            break;
+        default:
+            d = v->max;
+            break;
+    }
+    if(!v->count) return;          // no values, empty column
+    if(d == (double) (long long int) d)
+    {
+        fprintf(fp,"%lld",(long long int) d);
+    } else
+    {
+        fprintf(fp,"%.15g",d);
+    }
+}
+
+/* print the groups as tab separated table */
+void
+aggregate_report(FILE *fp)
+{
+    struct group **list,*g;
+    size_t i,n = 0;
+    int k;
+
+    if(!aggregating) return;
+
+    if(record_level) record_end();
+
+    list = xmalloc(sizeof(struct group *) * (group_count + 1));
+    for(i = 0;i < group_table_size;i++)
+    {
+        for(g = groups[i];g != NULL;g = g->next) list[n++] = g;
+    }
+    qsort(list,n,sizeof(struct group *),compare_groups);
+
+    for(k = 0;k < key_count;k++) fprintf(fp,"%s\t",key_names[k]);
+    for(k = 0;k < aggregate_count;k++) fprintf(fp,"%s%s",aggregates[k].title,k < aggregate_count - 1 ? "\t" : "\n");
+
+    for(i = 0;i < n;i++)
+    {
+        for(k = 0;k < key_count;k++) fprintf(fp,"%s\t",list[i]->key_text[k]);
+        for(k = 0;k < aggregate_count;k++)
+        {
+            print_value(fp,&aggregates[k],list[i],&list[i]->values[k]);
+            fputc(k < aggregate_count - 1 ? '\t' : '\n',fp);
+        }
+    }
+    free(list);
+}
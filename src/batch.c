@@ -0,0 +1,392 @@
+/* 
+   tlve - A program to parse tag-length-value structures and print them in different formats
+
+   Copyright (C) 2009 Timo Savinen
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.  
+*/ 
+#include "tlve.h"
+
+/* Batched reading of small input files. Files are opened, their sizes checked
+   and contents read for several files at once. On Linux io_uring is used, so that
+   one system call handles the whole batch. Otherwise plain system calls are used.
+ */
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(HAVE_SYS_SYSCALL_H) && defined(HAVE_SYS_MMAN_H) && defined(HAVE_STRUCT_STATX)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register) && defined(IORING_FEAT_CUR_PERSONALITY)
+#define USE_IO_URING 1
+#endif
+#endif
+
+/* files larger than this are read normally */
+#define BATCH_MAX_FILE_SIZE ((size_t) 1048576)
+
+#ifdef USE_IO_URING
+
+/* operation types in user_data */
+#define OP_OPEN  0
+#define OP_STATX 1
+#define OP_READ  2
+#define OP_CLOSE 3
+
+struct ring
+{
+    int fd;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int sq_entries;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned int pending;          // sqes queued but not submitted
+};
+
+static TLS struct ring ring;
+
+/* -1 = not tried, 0 = not available, 1 = in use */
+static TLS int ring_state = -1;
+
+/* check that kernel supports all needed operations */
+static int
+ring_probe()
+{
+    struct io_uring_probe *probe;
+    size_t size;
+    int ok;
+
+    size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    probe = xmalloc(size);
+    memset(probe,0,size);
+
+    ok = syscall(__NR_io_uring_register,ring.fd,IORING_REGISTER_PROBE,probe,256) == 0 &&
+        probe->last_op >= IORING_OP_STATX &&
+        (probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED) &&
+        (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED) &&
+        (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) &&
+        (probe->ops[IORING_OP_CLOSE].flags & IO_URING_OP_SUPPORTED);
+
+    free(probe);
+    return ok;
+}
+
+/* set up the ring, return 0 if io_uring cannot be used */
+static int
+ring_setup(unsigned int entries)
+{
+    struct io_uring_params p;
+    size_t sq_size,cq_size;
+    BUFFER *sq_ptr = MAP_FAILED,*cq_ptr = MAP_FAILED;
+
+    ring.sqes = MAP_FAILED;
+    memset(&p,0,sizeof(p));
+    ring.fd = (int) syscall(__NR_io_uring_setup,entries,&p);
+    if(ring.fd < 0) return 0;
+
+    sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if(cq_size > sq_size) sq_size = cq_size;
+        cq_size = sq_size;
+    }
+
+    sq_ptr = mmap(NULL,sq_size,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,ring.fd,IORING_OFF_SQ_RING);
+    if(sq_ptr == MAP_FAILED) goto fail;
+
+    if(p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        cq_ptr = sq_ptr;
+    } else
+    {
+        cq_ptr = mmap(NULL,cq_size,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,ring.fd,IORING_OFF_CQ_RING);
+        if(cq_ptr == MAP_FAILED) goto fail;
+    }
+
+    ring.sqes = mmap(NULL,p.sq_entries * sizeof(struct io_uring_sqe),PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,ring.fd,IORING_OFF_SQES);
+    if(ring.sqes == MAP_FAILED) goto fail;
+
+    ring.sq_head = (unsigned int *) (sq_ptr + p.sq_off.head);
+    ring.sq_tail = (unsigned int *) (sq_ptr + p.sq_off.tail);
+    ring.sq_mask = (unsigned int *) (sq_ptr + p.sq_off.ring_mask);
+    ring.sq_array = (unsigned int *) (sq_ptr + p.sq_off.array);
+    ring.sq_entries = p.sq_entries;
+    ring.cq_head = (unsigned int *) (cq_ptr + p.cq_off.head);
+    ring.cq_tail = (unsigned int *) (cq_ptr + p.cq_off.tail);
+    ring.cq_mask = (unsigned int *) (cq_ptr + p.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe *) (cq_ptr + p.cq_off.cqes);
+    ring.pending = 0;
+
+    if(!ring_probe()) goto fail;
+    return 1;
+
+fail:
+    if(ring.sqes != MAP_FAILED) munmap(ring.sqes,p.sq_entries * sizeof(struct io_uring_sqe));
+    if(cq_ptr != MAP_FAILED && cq_ptr != sq_ptr) munmap(cq_ptr,cq_size);
+    if(sq_ptr != MAP_FAILED) munmap(sq_ptr,sq_size);
+    close(ring.fd);
+    return 0;
+}
+
+/* get next free submission queue entry */
+static struct io_uring_sqe *
+ring_get_sqe()
+{
+    unsigned int tail,index;
+    struct io_uring_sqe *sqe;
+
+    tail = *ring.sq_tail + ring.pending;
+    index = tail & *ring.sq_mask;
+    sqe = &ring.sqes[index];
+    memset(sqe,0,sizeof(struct io_uring_sqe));
+    ring.sq_array[index] = index;
+    ring.pending++;
+    return sqe;
+}
+
+/* submit queued entries, if wait is true wait for all of them to complete */
+static void
+ring_submit(int wait)
+{
+    unsigned int count = ring.pending;
+    int rc;
+
+    if(!count) return;
+
+    __atomic_store_n(ring.sq_tail,*ring.sq_tail + count,__ATOMIC_RELEASE);
+    ring.pending = 0;
+
+    do
+    {
+        rc = (int) syscall(__NR_io_uring_enter,ring.fd,count,wait ? count : 0,wait ? IORING_ENTER_GETEVENTS : 0,NULL,0);
+    } while(rc < 0 && errno == EINTR);
+    if(rc < 0) panic("io_uring_enter failed",strerror(errno),NULL);
+}
+
+/* get next completion, return 0 if none */
+static int
+ring_get_cqe(struct io_uring_cqe *cqe)
+{
+    unsigned int head;
+
+    head = *ring.cq_head;
+    if(head == __atomic_load_n(ring.cq_tail,__ATOMIC_ACQUIRE)) return 0;
+    *cqe = ring.cqes[head & *ring.cq_mask];
+    __atomic_store_n(ring.cq_head,head + 1,__ATOMIC_RELEASE);
+    return 1;
+}
+
+/* queue read of file i, got octets have been read already. One extra octet is asked
+   to notice if file has grown
+ */
+static void
+ring_queue_read(int i,int fd,BUFFER *data,size_t len,size_t got)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = ring_get_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t) (uintptr_t) (data + got);
+    sqe->len = (uint32_t) (len + 1 - got);
+    sqe->off = (uint64_t) got;
+    sqe->user_data = ((uint64_t) i << 2) | OP_READ;
+}
+
+/* wait until count submitted entries have completed and save the results,
+   short reads are continued until the whole file is read
+ */
+static void
+ring_complete(unsigned int count,int *fds,struct statx *stx,BUFFER **data,size_t *len,size_t *got)
+{
+    struct io_uring_cqe cqe;
+    int i,op;
+
+    while(count)
+    {
+        if(!ring_get_cqe(&cqe))
+        {
+            if(syscall(__NR_io_uring_enter,ring.fd,0,1,IORING_ENTER_GETEVENTS,NULL,0) < 0 && errno != EINTR)
+                panic("io_uring_enter failed",strerror(errno),NULL);
+            continue;
+        }
+        count--;
+        i = (int) (cqe.user_data >> 2);
+        op = (int) (cqe.user_data & 3);
+        switch(op)
+        {
+            case OP_OPEN:
+                fds[i] = cqe.res;
+                break;
+            case OP_STATX:
+                if(cqe.res < 0) stx[i].stx_mask = 0;
+                break;
+            case OP_READ:
+                if(cqe.res < 0 || got[i] + (size_t) cqe.res > len[i])  // error or file has grown after statx
+                {
+                    free(data[i]);
+                    data[i] = NULL;
+                } else if(cqe.res == 0 || got[i] + (size_t) cqe.res == len[i])   // end of file
+                {
+                    len[i] = got[i] + (size_t) cqe.res;
+                } else                                                  // short read, read the rest
+                {
+                    got[i] += (size_t) cqe.res;
+                    ring_queue_read(i,fds[i],data[i],len[i],got[i]);
+                    ring_submit(0);
+                    count++;
+                }
+                break;
+        }
+    }
+}
+
+/* read files using io_uring. Three batches are submitted: open and statx, read and close */
+static void
+ring_read(char **names,BUFFER **data,size_t *len,int count)
+{
+    int *fds;
+    struct statx *stx;
+    struct io_uring_sqe *sqe;
+    size_t *got;
+    int i,n;
+
+    fds = xmalloc(count * sizeof(int));
+    stx = xmalloc(count * sizeof(struct statx));
+    got = xcalloc((size_t) count,sizeof(size_t));
+
+    for(i = 0;i < count;i++)
+    {
+        fds[i] = -1;
+        stx[i].stx_mask = 0;
+
+        sqe = ring_get_sqe();
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t) (uintptr_t) names[i];
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        sqe->user_data = ((uint64_t) i << 2) | OP_OPEN;
+
+        sqe = ring_get_sqe();
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t) (uintptr_t) names[i];
+        sqe->len = STATX_TYPE | STATX_SIZE;
+        sqe->off = (uint64_t) (uintptr_t) &stx[i];
+        sqe->user_data = ((uint64_t) i << 2) | OP_STATX;
+    }
+    ring_submit(1);
+    ring_complete(2 * count,fds,stx,data,len,got);
+
+    n = 0;
+    for(i = 0;i < count;i++)
+    {
+        if(fds[i] < 0) continue;
+        if(!(stx[i].stx_mask & STATX_SIZE) || !(stx[i].stx_mask & STATX_TYPE)) continue;
+        if(!S_ISREG(stx[i].stx_mode) || stx[i].stx_size > (uint64_t) BATCH_MAX_FILE_SIZE) continue;
+
+        len[i] = (size_t) stx[i].stx_size;
+        data[i] = xmalloc(len[i] + 1);
+        ring_queue_read(i,fds[i],data[i],len[i],0);
+        n++;
+    }
+    ring_submit(1);
+    ring_complete(n,fds,stx,data,len,got);
+
+    n = 0;
+    for(i = 0;i < count;i++)
+    {
+        if(fds[i] < 0) continue;
+        sqe = ring_get_sqe();
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = fds[i];
+        sqe->user_data = ((uint64_t) i << 2) | OP_CLOSE;
+        n++;
+    }
+    ring_submit(1);
+    ring_complete(n,fds,stx,data,len,got);
+
+    free(fds);
+    free(stx);
+    free(got);
+}
+#endif
+
+/* read one file using plain system calls */
+static void
+plain_read(char *name,BUFFER **data,size_t *len)
+{
+    struct stat st;
+    int fd;
+    ssize_t got;
+    size_t total = 0;
+
+    fd = open(name,O_RDONLY);
+    if(fd < 0) return;
+
+    if(fstat(fd,&st) == 0 && S_ISREG(st.st_mode) && st.st_size <= (off_t) BATCH_MAX_FILE_SIZE)
+    {
+        *len = (size_t) st.st_size;
+        *data = xmalloc(*len + 1);
+        do
+        {
+            got = read(fd,*data + total,*len + 1 - total);
+            if(got > 0) total += (size_t) got;
+        } while((got > 0 && total <= *len) || (got < 0 && errno == EINTR));
+
+        if(got < 0 || total > *len)       // error or file has grown after fstat
+        {
+            free(*data);
+            *data = NULL;
+        } else
+        {
+            *len = total;
+        }
+    }
+    close(fd);
+}
+
+/* read count files to memory. data[i] is set to the contents of file names[i] and
+   len[i] to its length. data[i] is NULL if the file could not be read
+   or the file is too large, those are opened normally
+ */
+void
+batch_read(char **names,BUFFER **data,size_t *len,int count)
+{
+    int i;
+
+    for(i = 0;i < count;i++)
+    {
+        data[i] = NULL;
+        len[i] = 0;
+    }
+
+#ifdef USE_IO_URING
+    if(ring_state == -1) ring_state = ring_setup(2 * BATCH_MAX_FILES);
+    if(ring_state == 1 && count <= BATCH_MAX_FILES)
+    {
+        ring_read(names,data,len,count);
+        return;
+    }
+#endif
+
+    for(i = 0;i < count;i++) plain_read(names[i],&data[i],&len[i]);
+}
@@ -0,0 +1,317 @@
+/* 
+   tlve - A program to parse tag-length-value structures and print them in different formats
+
+   Copyright (C) 2009 Timo Savinen
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.  
+*/ 
+#include "tlve.h"
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#include <time.h>
+
+/* Microbenchmarks for the decoding and formatting functions, run with "make bench".
+
+   Usage: tlve-bench RC-FILE [NAME]
+
+   RC-FILE must contain structure tap311 (examples/tap_3_11.rc). If NAME is given,
+   only benchmarks having NAME in their name are run.
+   Every benchmark is run until it has taken at least MIN_TIME seconds.
+ */
+
+#define MIN_TIME 0.25
+
+/* size of data for buffer search */
+#define SEARCH_SIZE 65536
+
+/* size of values for converters */
+#define VALUE_SIZE 32
+
+struct bench
+{
+    char *name;
+    void (*setup)();             // prepare data, can be NULL
+    void (*run)(long);           // run the function count times
+    size_t bytes;                // bytes processed in one call, 0 if not meaningful
+};
+
+/* results are accumulated here to keep the compiler from removing the calls */
+static volatile size_t sink;
+
+static BUFFER *input = NULL;
+static struct tlvitem item;
+static BUFFER value[VALUE_SIZE];
+static char text[VALUE_SIZE * 2 + 1];
+
+/* return time in seconds */
+static double
+now()
+{
+#ifdef HAVE_CLOCK_GETTIME
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+#else
+    struct timeval tv;
+
+    gettimeofday(&tv,NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1e6;
+#endif
+}
+
+/* make data the only input and load it to buffer */
+static void
+use_input(BUFFER *data,size_t len)
+{
+    clear_input_files();
+    if(input != NULL) free(input);
+    input = xmalloc(len);
+    memcpy(input,data,len);
+    set_input_memory(input,len);
+    open_next_input_file();
+    buffer(B_INIT,0);
+}
+
+/* BER tag and length decoding */
+
+static void
+setup_short_tag()
+{
+    use_input((BUFFER *) "\x81\x04\x01\x02\x03\x04",6);
+}
+
+static void
+setup_long_tag()
+{
+    use_input((BUFFER *) "\xbf\x82\x29\x83\x01\x00\x00",7);
+}
+
+static void
+run_ber_tag(long count)
+{
+    char tag[MAX_TAG_SIZE];
+    TYPE type,ctype;
+
+    while(count--) sink += read_ber_tag(tag,&type,&ctype);
+}
+
+static void
+run_ber_length(long count)
+{
+    FILE_OFFSET length;
+
+    while(count--)
+    {
+        sink += read_ber_length(&length,3);
+        sink += (size_t) length;
+    }
+}
+
+/* tlv definition lookup */
+
+static char *tags[] = {"A-1","A-9","A-297","A-302","A-36","C-99",NULL};
+
+static void
+run_find_tlvdef(long count)
+{
+    int i = 0;
+
+    while(count--)
+    {
+        if(find_tlvdef(tags[i],T_BER) != NULL) sink++;
+        if(tags[++i] == NULL) i = 0;
+    }
+}
+
+/* value converters */
+
+static void
+setup_value(TYPE type,size_t length)
+{
+    int i;
+
+    for(i = 0;i < VALUE_SIZE;i++) value[i] = (BUFFER) ('0' + i % 75);
+    value[0] = 0x06;                 // sensible first octets for oid and bit string
+    value[1] = 0x2b;
+    item.tl = tl;
+    item.tlv = NULL;
+    item.raw_value = value;
+    item.value_length = length;
+    item.valuetype = type;
+}
+
+static void setup_hex() { setup_value(T_HEX,VALUE_SIZE); }
+static void setup_hexs() { setup_value(T_HEXS,VALUE_SIZE); }
+static void setup_bcd() { setup_value(T_BCD,VALUE_SIZE); }
+static void setup_bcds() { setup_value(T_BCDS,VALUE_SIZE); }
+static void setup_dec() { setup_value(T_DEC,VALUE_SIZE); }
+static void setup_escaped() { setup_value(T_ESCAPED,VALUE_SIZE); }
+static void setup_string() { setup_value(T_STRING,VALUE_SIZE); }
+static void setup_oid() { setup_value(T_OID,VALUE_SIZE); }
+static void setup_bitstring() { setup_value(T_BITSTRING,VALUE_SIZE); }
+static void setup_int() { setup_value(T_INTBE,4); }
+static void setup_uint() { setup_value(T_UINTBE,4); }
+
+static void
+run_convert(long count)
+{
+    while(count--)
+    {
+        convert_value(&item);
+        sink += (size_t) item.converted_value[0];
+    }
+}
+
+/* print template expansion, output goes to /dev/null */
+
+static void
+setup_print()
+{
+    setup_value(T_STRING,VALUE_SIZE);
+    item.level = FIRST_LEVEL + 2;
+    item.tlv = find_tlvdef("A-36",T_BER);
+    strcpy(item.tag,"A-36");
+    convert_value(&item);
+}
+
+static void
+run_print(long count)
+{
+    while(count--) print_primitive_item(&item,structure.p);
+}
+
+/* character set conversion */
+
+static void
+setup_iconv()
+{
+    int i;
+
+    for(i = 0;i < VALUE_SIZE;i++) text[i] = (char) (i % 2 ? 0xe4 : 'a' + i % 26);
+    text[VALUE_SIZE] = 0;
+}
+
+static void
+run_iconv(long count)
+{
+    while(count--) sink += (size_t) make_iconv(text,"ISO-8859-1","UTF-8")[0];
+}
+
+/* buffer search, terminator is found at the end of data */
+
+static void
+setup_search()
+{
+    BUFFER *data = xmalloc(SEARCH_SIZE);
+
+    memset(data,'a',SEARCH_SIZE);
+    data[SEARCH_SIZE - 2] = 0;
+    data[SEARCH_SIZE - 1] = 0;
+    use_input(data,SEARCH_SIZE);
+    free(data);
+}
+
+static void
+run_search(long count)
+{
+    while(count--) sink += (size_t) search_buffer_s((BUFFER *) "\0\0",2,0);
+}
+
+static struct bench benches[] =
+{
+    {"read_ber_tag short",setup_short_tag,run_ber_tag,2},
+    {"read_ber_tag long",setup_long_tag,run_ber_tag,3},
+    {"read_ber_length long",setup_long_tag,run_ber_length,4},
+    {"find_tlvdef",NULL,run_find_tlvdef,0},
+    {"format hex",setup_hex,run_convert,VALUE_SIZE},
+    {"format hexs",setup_hexs,run_convert,VALUE_SIZE},
+    {"format bcd",setup_bcd,run_convert,VALUE_SIZE},
+    {"format bcds",setup_bcds,run_convert,VALUE_SIZE},
+    {"format dec",setup_dec,run_convert,VALUE_SIZE},
+    {"format escaped",setup_escaped,run_convert,VALUE_SIZE},
+    {"format string",setup_string,run_convert,VALUE_SIZE},
+    {"format oid",setup_oid,run_convert,VALUE_SIZE},
+    {"format bitstring",setup_bitstring,run_convert,VALUE_SIZE},
+    {"format int",setup_int,run_convert,4},
+    {"format uint",setup_uint,run_convert,4},
+    {"print_item",setup_print,run_print,VALUE_SIZE},
+    {"make_iconv",setup_iconv,run_iconv,VALUE_SIZE},
+    {"search_buffer_s",setup_search,run_search,SEARCH_SIZE},
+    {NULL,NULL,NULL,0}
+};
+
+/* run one benchmark, double the count until the run takes MIN_TIME */
+static void
+run_bench(struct bench *b)
+{
+    long count = 1000;
+    double start,elapsed,ns;
+
+    if(b->setup != NULL) b->setup();
+
+    b->run(count);                     // warm up
+
+    while(1)
+    {
+        start = now();
+        b->run(count);
+        elapsed = now() - start;
+        if(elapsed >= MIN_TIME) break;
+        count *= 2;
+    }
+
+    ns = elapsed * 1e9 / (double) count;
+    if(b->bytes)
+    {
+        printf("%-24s %12.1f %12.1f\n",b->name,ns,(double) b->bytes * (double) count / elapsed / 1e6);
+    } else
+    {
+        printf("%-24s %12.1f %12s\n",b->name,ns,"-");
+    }
+    fflush(stdout);
+}
+
+int
+main(int argc,char **argv)
+{
+    struct bench *b;
+
+    if(argc < 2)
+    {
+        fprintf(stderr,"Usage: %s RC-FILE [NAME]\n",argv[0]);
+        exit(1);
+    }
+
+    parse_rc(argv[1],"tap311",NULL);
+    execute_init();
+    set_read_ahead(0);
+    set_batch_files(0);
+    print_list_open_output("/dev/null");
+
+    printf("%-24s %12s %12s\n","benchmark","ns/op","MB/s");
+
+    for(b = benches;b->name != NULL;b++)
+    {
+        if(argc > 2 && strstr(b->name,argv[2]) == NULL) continue;
+        run_bench(b);
+    }
+
+    print_list_close_output();
+    clear_input_files();
+    return 0;
+}
@@ -0,0 +1,297 @@
+/* 
+   tlve - A program to parse tag-length-value structures and print them in different formats
+
+   Copyright (C) 2009 Timo Savinen
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.  
+*/ 
+#include "tlve.h"
+#include "libtlve.h"
+
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#include <time.h>
+
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+
+#ifdef HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
+
+/* End-to-end benchmark driver. Runs tlve over the input files using different
+   profiles (sets of options) and reports throughput and peak memory usage.
+   Each profile is run several times and the fastest run is reported.
+ */
+
+#define EXIT_FAILURE 1
+#define EXIT_SUCCESS 0
+
+#define MAX_PROFILES 32
+#define MAX_ARGS 64
+
+struct profile
+{
+    char *name;
+    char *args;              // options given to tlve, separated by spaces
+};
+
+/* default profiles, these are for the structure tap311 in examples/tap_3_11.rc */
+static struct profile default_profiles[] =
+{
+    {"plain",""},
+    {"dump","-p dump"},
+    {"search","-l 3 -e CallingNumber=^35"},
+    {"projection","-n CallingNumber,ChargeableUnits"},
+    {NULL,NULL}
+};
+
+static struct profile profiles[MAX_PROFILES + 1];
+static int profile_count = 0;
+
+static char short_opts[] = "t:c:s:P:r:h";
+
+#ifdef HAVE_GETOPT_LONG
+static struct option long_opts[] =
+{
+  {"tlve", 1, 0, 't'},
+  {"configuration", 1, 0, 'c'},
+  {"structure", 1, 0, 's'},
+  {"profile", 1, 0, 'P'},
+  {"runs", 1, 0, 'r'},
+  {"help", 0, 0, 'h'},
+  {NULL, 0, NULL, 0}
+};
+#endif
+
+static double
+now()
+{
+#ifdef HAVE_CLOCK_GETTIME
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+#else
+    struct timeval tv;
+
+    gettimeofday(&tv,NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1e6;
+#endif
+}
+
+/* element counting for libtlve */
+static int
+count_element(void *user,const struct tlve_element *e)
+{
+    (*(long long *) user)++;
+    return 0;
+}
+
+/* count the elements in files using the library */
+static long long
+count_elements(char *rc,char *structure_name,char **files,int file_count)
+{
+    struct tlve_callbacks cb = {count_element,count_element,NULL};
+    tlve_parser *p;
+    long long count = 0;
+    int i,fd;
+
+    p = tlve_new();
+    if(tlve_load(p,rc,structure_name) != TLVE_OK) panic("Cannot read configuration",(char *) tlve_error(p),NULL);
+    tlve_set_callbacks(p,&cb,&count);
+
+    for(i = 0;i < file_count;i++)
+    {
+        fd = open(files[i],O_RDONLY);
+        if(fd == -1) panic("Cannot open file",files[i],strerror(errno));
+        if(tlve_parse_fd(p,fd) == TLVE_ERROR) panic("Cannot parse file",(char *) tlve_error(p),NULL);
+        close(fd);
+    }
+
+    tlve_free(p);
+    return count;
+}
+
+/* run tlve once, return elapsed time and peak rss in kilobytes to *rss */
+static double
+run_tlve(char **argv,long *rss)
+{
+    pid_t pid;
+    int status;
+    double start;
+    struct rusage ru;
+
+    start = now();
+    fflush(NULL);
+    pid = fork();
+    if(pid == (pid_t) 0)
+    {
+        execv(argv[0],argv);
+        fprintf(stderr,"%s: Cannot run %s: %s\n",program_name,argv[0],strerror(errno));
+        _exit(EXIT_FAILURE);
+    } else if(pid < (pid_t) 0)
+    {
+        panic("Cannot fork",strerror(errno),NULL);
+    }
+
+#ifdef HAVE_WAIT4
+    if(wait4(pid,&status,0,&ru) == -1) panic("Wait failed",strerror(errno),NULL);
+#else
+    if(waitpid(pid,&status,0) == -1) panic("Wait failed",strerror(errno),NULL);
+    getrusage(RUSAGE_CHILDREN,&ru);            // maximum of all runs
+#endif
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) panic("tlve failed",argv[0],NULL);
+
+    *rss = ru.ru_maxrss;
+    return now() - start;
+}
+
+static void
+usage(int status)
+{
+    printf("Usage: %s [OPTION]... FILE...\n",program_name);
+    printf("\
+Run tlve over FILEs using different profiles and report the throughput.\n\n\
+Options:\n\
+  -t, --tlve PROGRAM          tlve program to run (default ./tlve)\n\
+  -c, --configuration NAME    configuration file\n\
+  -s, --structure NAME        structure to use (default tap311)\n\
+  -P, --profile NAME:OPTIONS  run tlve with OPTIONS, can be given several times\n\
+                              (default profiles plain, dump, search and projection are for tap311)\n\
+  -r, --runs COUNT            run each profile COUNT times and report the fastest (default 3)\n\
+  -h, --help                  display this help and exit\n");
+    exit(status);
+}
+
+int
+main(int argc,char **argv)
+{
+    int opt,i,j,argc_tlve,run;
+    char *tlve = "./tlve";
+    char *config_to_use = NULL;
+    char *structure_to_use = "tap311";
+    int runs = 3;
+    char *targv[MAX_ARGS + 1];
+    char *args,*p;
+    double best,elapsed,megabytes = 0;
+    long rss,peak_rss;
+    long long element_count;
+    struct stat st;
+
+    program_name = "tlve-benchrun";
+
+#ifdef HAVE_GETOPT_LONG
+    while ((opt = getopt_long(argc,argv,short_opts,long_opts,NULL)) != -1)
+#else
+    while ((opt = getopt(argc,argv,short_opts)) != -1)
+#endif
+    {
+        switch(opt)
+        {
+            case 't':
+                tlve = xstrdup(optarg);
+                break;
+            case 'c':
+                config_to_use = xstrdup(optarg);
+                break;
+            case 's':
+                structure_to_use = xstrdup(optarg);
+                break;
+            case 'P':
+                if(profile_count == MAX_PROFILES) panic("Too many profiles",NULL,NULL);
+                p = strchr(optarg,':');
+                if(p == NULL) panic("Profile must be given as NAME:OPTIONS",optarg,NULL);
+                *p = 0;
+                profiles[profile_count].name = xstrdup(optarg);
+                profiles[profile_count++].args = xstrdup(p + 1);
+                break;
+            case 'r':
+                runs = atoi(optarg);
+                if(runs < 1) runs = 1;
+                break;
+            case 'h':
+                usage(EXIT_SUCCESS);
+                break;
+            default:
+                usage(EXIT_FAILURE);
+                break;
+        }
+    }
+
+    if(config_to_use == NULL || optind == argc) usage(EXIT_FAILURE);
+
+    if(!profile_count)
+    {
+        for(i = 0;default_profiles[i].name != NULL;i++) profiles[profile_count++] = default_profiles[i];
+    }
+
+    for(i = optind;i < argc;i++)
+    {
+        if(stat(argv[i],&st) != 0) panic("Cannot stat file",argv[i],strerror(errno));
+        megabytes += (double) st.st_size / 1e6;
+    }
+
+    element_count = count_elements(config_to_use,structure_to_use,argv + optind,argc - optind);
+
+    printf("%.1f MB, %lld elements\n\n",megabytes,element_count);
+    printf("%-16s %10s %10s %14s %12s\n","profile","seconds","MB/s","elements/s","peak RSS KB");
+
+    for(i = 0;i < profile_count;i++)
+    {
+        argc_tlve = 0;
+        targv[argc_tlve++] = tlve;
+        targv[argc_tlve++] = "-c";
+        targv[argc_tlve++] = config_to_use;
+        targv[argc_tlve++] = "-s";
+        targv[argc_tlve++] = structure_to_use;
+        targv[argc_tlve++] = "-o";
+        targv[argc_tlve++] = "/dev/null";
+
+        args = xstrdup(profiles[i].args);
+        for(p = strtok(args," ");p != NULL;p = strtok(NULL," "))
+        {
+            if(argc_tlve == MAX_ARGS) panic("Too many options in profile",profiles[i].name,NULL);
+            targv[argc_tlve++] = p;
+        }
+        for(j = optind;j < argc;j++)
+        {
+            if(argc_tlve == MAX_ARGS) panic("Too many input files",NULL,NULL);
+            targv[argc_tlve++] = argv[j];
+        }
+        targv[argc_tlve] = NULL;
+
+        best = 0;
+        peak_rss = 0;
+        for(run = 0;run < runs;run++)
+        {
+            elapsed = run_tlve(targv,&rss);
+            if(!run || elapsed < best) best = elapsed;
+            if(rss > peak_rss) peak_rss = rss;
+        }
+
+        printf("%-16s %10.3f %10.1f %14.0f %12ld\n",profiles[i].name,best,megabytes / best,(double) element_count / best,peak_rss);
+        fflush(stdout);
+        free(args);
+    }
+
+    exit(EXIT_SUCCESS);
+}
@@ -19,31 +19,97 @@
 */ 
 #include "tlve.h"
 
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE)
+#define USE_READ_AHEAD 1
+#include <pthread.h>
+#endif
+
 
 /* input buffer size, this dictates etc. the maximum tlv triplet size */
 #define BUFFER_SIZE ((size_t) 10485760)
 
+/* space left in the beginning of read-ahead segment for unread data of the previous buffer */
+#define AHEAD_RESERVE (BUFFER_SIZE >> 3)
+
+/* Two buffers are used when reading ahead, the other is filled while the current is parsed */
+static TLS BUFFER *buffers[2];
+static TLS int current_buffer = 0;
+
 /* Pointers to different points in buffer */
 /* Start of the buffer */
-static BUFFER *buffer_start;
+static TLS BUFFER *buffer_start;
+
+/* Start of the valid data in buffer */
+static TLS BUFFER *data_start;
 
 /* Low water, point after the flush command reads new data and makes buffer stale */
-static BUFFER *low_water;
+static TLS BUFFER *low_water;
 
 /* pointer to the next readable octet */
-static BUFFER *new_data;
+static TLS BUFFER *new_data;
 
 /* Data end point, pointer to the last octet + 1  of the data */
-static BUFFER *data_end;
+static TLS BUFFER *data_end;
 
 /* buffer end point, pointer to the last octet + 1 of the data */
-static BUFFER *buffer_end;
+static TLS BUFFER *buffer_end;
+
+/* Size of peeked data from input, peeked data is returned before reading more from the stream */
+#define PEEK_SIZE 4
+
+/* compressed files are decompressed in-process */
+static TLS int decompression = 1;
+
+/* offset of the last error reported by buffer_error, -1 = none */
+static TLS FILE_OFFSET error_offset = (FILE_OFFSET) -1;
+
+/* number of input preprocessors run ahead, including the current file */
+static TLS int preprocessors = 4;
+
+/* preprocessor states for input file */
+#define PRE_UNKNOWN 0        // not yet checked
+#define PRE_NONE    1        // file is read without preprocessor
+#define PRE_STARTED 2        // preprocessor is running, output in pre_fp
+
+/* count of buffer flushes, data read before a flush may have been overwritten */
+static TLS unsigned long buffer_flushes = 0;
 
-/* Peeked char from input preprosessor */
-static int ungetchar = -1;
+/* input is read ahead by an I/O thread */
+static TLS int read_ahead = 1;
 
-/* state variable */
-static int buffer_state;
+/* number of small input files read to memory at once */
+static TLS int batch_files = BATCH_MAX_FILES;
+
+#ifdef USE_READ_AHEAD
+/* read-ahead request states */
+#define AHEAD_IDLE 0
+#define AHEAD_REQUESTED 1
+#define AHEAD_DONE 2
+#define AHEAD_QUIT 3
+
+/* read-ahead request, the I/O thread uses only this structure and the file in it */
+struct read_ahead
+{
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int state;
+    struct input_file *file;         // file to read from
+    int prefetch;                    // open next file when end of file is reached
+    BUFFER *dst;                     // where to read
+    size_t len;                      // how much to read
+    size_t got;                      // how much was read
+};
+
+static TLS struct read_ahead *ahead = NULL;
+#endif
+
+/* read-ahead segment in the other buffer, data not yet moved to current buffer */
+static TLS BUFFER *seg_data = NULL;
+static TLS BUFFER *seg_end = NULL;
+static TLS int seg_eof = 1;              // end of file reached after the segment
+
+static void read_ahead_wait();
 
 /* List of input files */
 struct input_file
@@ -51,23 +117,46 @@ struct input_file
     char *name;
     FILE_OFFSET offset;
     FILE *fp;
+    struct decompressor *decoder;   // NULL if file is not compressed
+    BUFFER peek_data[PEEK_SIZE];    // peeked octets
+    size_t peek_len;                // octets in peek_data
+    size_t peek_pos;                // next octet to be returned
+    FILE *ahead_fp;                 // file opened ahead by the I/O thread
+    int batched;                    // file has been tried to read in batch
+    BUFFER *data;                   // contents of the file read in batch, NULL if read from fp
+    size_t data_len;
+    size_t data_pos;                // next octet to be read from data
+    int borrowed;                   // data is owned by caller, it is parsed in place
+    FILE_OFFSET size;               // size of the file for progress reports, -1 if not known, -2 if not checked
+    int pre_state;                  // preprocessor state, PRE_*
+    FILE *pre_fp;                   // output of the preprocessor started ahead
     struct input_file *next;
 };
 
 /* file list start */
-static struct input_file *files = NULL;
+static TLS struct input_file *files = NULL;
 
 /* Current file */
-static struct input_file *current_file = NULL;
+static TLS struct input_file *current_file = NULL;
 
 /* Total offset for all files */
-static FILE_OFFSET toffset = (FILE_OFFSET) 0;
+static TLS FILE_OFFSET toffset = (FILE_OFFSET) 0;
 
+/* Number of files to skip before opening the first file, used when resuming from checkpoint */
+static TLS int skip_files = 0;
 
+/* octets read from the current file are copied here when capturing, used by --raw */
+static TLS int capturing = 0;
+static TLS BUFFER *capture_data = NULL;
+static TLS size_t capture_len = 0;
+static TLS size_t capture_size = 0;
+static TLS FILE_OFFSET capture_offset;     // file offset of the first captured octet
 
-/* Add one input file to list */
-void
-set_input_file(char *name)
+
+
+/* Add one input file to list, return the new entry */
+static struct input_file *
+new_input_file(char *name)
 {
     register struct input_file *f = files;
 
@@ -86,6 +175,211 @@ set_input_file(char *name)
     f->offset = (FILE_OFFSET) 0;
     f->name = xstrdup(name);
     f->fp = NULL;
+    f->decoder = NULL;
+    f->ahead_fp = NULL;
+    f->batched = 0;
+    f->data = NULL;
+    f->borrowed = 0;
+    f->peek_len = 0;
+    f->peek_pos = 0;
+    f->pre_state = PRE_UNKNOWN;
+    f->pre_fp = NULL;
+    f->size = (FILE_OFFSET) -2;
+    return f;
+}
+
+/* Add one input file to list */
+void
+set_input_file(char *name)
+{
+    new_input_file(name);
+}
+
+/* Add memory area as input, data is parsed in place and it must not be
+   changed or released before parsing is finished
+ */
+void
+set_input_memory(BUFFER *data,size_t len)
+{
+    struct input_file *f = new_input_file("memory");
+
+    f->data = data;
+    f->data_len = len;
+    f->data_pos = 0;
+    f->borrowed = 1;
+    f->batched = 1;
+    f->pre_state = PRE_NONE;
+}
+
+/* Add an open stream as input, stream is closed after it has been read */
+void
+set_input_stream(FILE *fp,char *name)
+{
+    struct input_file *f = new_input_file(name);
+
+    f->ahead_fp = fp;
+    f->batched = 1;
+    f->pre_state = PRE_NONE;
+}
+
+/* close the input file and release the resources */
+static void
+close_input_file(struct input_file *f)
+{
+    if(f->decoder != NULL) decompress_close(f->decoder);
+    f->decoder = NULL;
+    if(f->data != NULL && !f->borrowed) free(f->data);
+    f->data = NULL;
+    if(f->fp != NULL && f->fp != stdin) fclose(f->fp);
+    f->fp = NULL;
+    if(f->ahead_fp != NULL) fclose(f->ahead_fp);
+    f->ahead_fp = NULL;
+    if(f->pre_fp != NULL) fclose(f->pre_fp);
+    f->pre_fp = NULL;
+}
+
+/* remove all input files, files which are open are closed */
+void
+clear_input_files()
+{
+    struct input_file *f;
+
+    read_ahead_wait();
+
+    while(files != NULL)
+    {
+        f = files;
+        files = f->next;
+        close_input_file(f);
+        free(f->name);
+        free(f);
+    }
+    current_file = NULL;
+    toffset = (FILE_OFFSET) 0;
+}
+
+/* enable or disable in-process decompression */
+void
+set_decompression(int on)
+{
+    decompression = on;
+}
+
+/* enable or disable reading ahead in I/O thread */
+void
+set_read_ahead(int on)
+{
+    read_ahead = on;
+}
+
+/* set the number of small files read in one batch, 0 or 1 disables batch reading */
+void
+set_batch_files(int count)
+{
+    if(count < 0) count = 0;
+    if(count > BATCH_MAX_FILES) count = BATCH_MAX_FILES;
+    batch_files = count;
+}
+
+/* set the number of preprocessors run in parallel */
+void
+set_preprocessors(int count)
+{
+    preprocessors = count > 0 ? count : 1;
+}
+
+/* read first octets of input stream to peek buffer */
+static void
+peek_input(struct input_file *f)
+{
+    f->peek_pos = 0;
+    f->peek_len = fread(f->peek_data,(size_t) 1,PEEK_SIZE,f->fp);
+}
+
+/* check if current file is compressed using the magic octets,
+   if so, open decompressor for the file
+ */
+static void
+check_compression()
+{
+    int type;
+
+    current_file->decoder = NULL;
+
+    if(!decompression) return;
+
+    if(current_file->data != NULL)
+    {
+        type = decompress_type(current_file->data,current_file->data_len);
+    } else
+    {
+        peek_input(current_file);
+        type = decompress_type(current_file->peek_data,current_file->peek_len);
+    }
+    if(type != D_NONE) current_file->decoder = decompress_open(type,current_file->name);
+}
+
+/* read the contents of small files starting from file f to memory.
+   Files already tried and stdin are not included in batch
+ */
+static void
+load_batch(struct input_file *f)
+{
+    char *names[BATCH_MAX_FILES];
+    BUFFER *data[BATCH_MAX_FILES];
+    size_t len[BATCH_MAX_FILES];
+    struct input_file *batch[BATCH_MAX_FILES];
+    int count = 0,i;
+
+    if(f->batched) return;
+
+    while(f != NULL && count < batch_files)
+    {
+        if(!f->batched && !(f->name[0] == '-' && f->name[1] == 0))
+        {
+            f->batched = 1;
+            batch[count] = f;
+            names[count++] = f->name;
+        }
+        f = f->next;
+    }
+
+    batch_read(names,data,len,count);
+
+    for(i = 0;i < count;i++)
+    {
+        batch[i]->data = data[i];
+        batch[i]->data_len = len[i];
+        batch[i]->data_pos = 0;
+    }
+}
+
+/* start preprocessors for the file f and for the next files
+   so that at most preprocessors files are being preprocessed.
+   Output of the started preprocessors is buffered in pipes
+   until the file is opened
+ */
+static void
+start_preprocessors(struct input_file *f)
+{
+    int count = 0;
+
+    while(f != NULL && count < preprocessors)
+    {
+        if(f->pre_state == PRE_UNKNOWN)
+        {
+            if(f->name[0] == '-' && f->name[1] == 0)
+            {
+                f->pre_state = PRE_NONE;
+            } else
+            {
+                f->pre_fp = preproc_start(f->name);
+                f->pre_state = PRE_STARTED;
+            }
+        }
+        if(f->pre_state == PRE_STARTED) count++;
+        f = f->next;
+    }
 }
 
 /* open next input file, return 0 if no more files */
@@ -93,92 +387,343 @@ set_input_file(char *name)
 int
 open_next_input_file()
 {
+    read_ahead_wait();
+
     if(current_file == NULL)
     {
         current_file = files;
+        while(skip_files && current_file != NULL)
+        {
+            current_file = current_file->next;
+            skip_files--;
+        }
     } else
     {
-        fclose(current_file->fp); 
+        close_input_file(current_file);
         current_file = current_file->next;
     }
 
-    if(current_file == NULL) return 0;
+    if(current_file == NULL)
+    {
+        buffer_free();
+        return 0;
+    }
 
     if(current_file->name[0] == '-' && current_file->name[1] == 0)
     {
         current_file->fp = stdin;
         current_file->name = "stdin";
+        check_compression();
     } else
     {
-        int fds[2];
-        pid_t pid;
-        char command[1024];
-
         if(tlve_open != NULL && tlve_open[0] != '\000')                // use preprocessor
         {
-#if defined(HAVE_WORKING_FORK) && defined(HAVE_DUP2) && defined(HAVE_PIPE)
-            sprintf(command,tlve_open,current_file->name);
-            if (pipe(fds) != 0) panic("Cannot create pipe",strerror(errno),NULL);
-            pid = fork();
-            if(pid == (pid_t) 0) /* Child */
-            {
-                close(fds[0]);
-                if(dup2(fds[1],STDOUT_FILENO) == -1) panic("dup2 error",strerror(errno),NULL);
-                if(execl(SHELL_CMD, "sh", "-c", command, NULL) == -1) panic("Starting a shell with execl failed",command,strerror(errno));
-                close(fds[1]);
-                _exit(EXIT_SUCCESS);
-            } else if(pid > (pid_t) 0)
+            start_preprocessors(current_file);
+
+            if(current_file->pre_state == PRE_STARTED)
             {
-                close(fds[1]);
-                current_file->fp = fdopen(fds[0],"r");
-                if(current_file->fp == NULL) panic("Cannot read from command",command,strerror(errno));
+                current_file->fp = current_file->pre_fp;
+                current_file->pre_fp = NULL;
 
-                ungetchar = fgetc(current_file->fp);
+                peek_input(current_file);
 
-                if(ungetchar == EOF)       // check if pipe returns something, if not open file normally
+                if(!current_file->peek_len)       // check if pipe returns something, if not open file normally
                 {
-                    ungetchar = -1;
                     fclose(current_file->fp);
                     current_file->fp = NULL;
                 }
+            }
+        } else if(batch_files > 1)
+        {
+            load_batch(current_file);
+        }
 
+        if(current_file->data != NULL)
+        {
+            if(current_file->ahead_fp != NULL)
+            {
+                fclose(current_file->ahead_fp);
+                current_file->ahead_fp = NULL;
+            }
+            check_compression();
+        } else if(current_file->fp == NULL)
+        {
+            if(current_file->ahead_fp != NULL)
+            {
+                current_file->fp = current_file->ahead_fp;
+                current_file->ahead_fp = NULL;
             } else
             {
-                panic("Cannot fork",strerror(errno),NULL);
+                current_file->fp = fopen(current_file->name,"rb");
+                if(current_file->fp == NULL) data_error("Error in opening file",current_file->name,strerror(errno));
             }
-#else
-        panic("Input preprocessing is not supported in this system",NULL,NULL);
-#endif
+            check_compression();
         }
-        if(current_file->fp == NULL) current_file->fp = xfopen(current_file->name,"r",'b');
     }
     return 1;
 }
 
 /* read from input stream. 
-   Check if ungetchar contains a valid char and write it to buffer then read nmenb - 1 chars
+   Return the peeked octets first and then read the rest from stream
    NOTE! it is assumed that size == 1...
 */
 
 static size_t
-uc_fread(uint8_t *ptr, size_t size, size_t nmemb, FILE *stream)
+uc_fread(struct input_file *f,BUFFER *ptr, size_t size, size_t nmemb)
 {
     size_t ret = 0;
 
-    if(ungetchar != -1)  // there is peeked char in ungetchar, write it to buffer and read the rest
+    while(f->peek_pos < f->peek_len && ret < nmemb)  // there are peeked octets, write them to buffer and read the rest
     {
-        *ptr = (uint8_t) ungetchar;
-        ungetchar = -1;
-        ptr++;
-        nmemb--;
-        ret = 1;
+        *ptr++ = f->peek_data[f->peek_pos++];
+        ret++;
     }
 
-    ret += fread(ptr,size,nmemb,stream);
+    if(ret < nmemb) ret += fread(ptr,size,nmemb - ret,f->fp);
     return ret;
 }
 
+/* read octets from file, from memory if file is read in batch */
+static size_t
+raw_read(struct input_file *f,BUFFER *ptr,size_t len)
+{
+    size_t left;
+
+    if(f->data == NULL) return uc_fread(f,ptr,(size_t) 1,len);
+
+    left = f->data_len - f->data_pos;
+    if(len > left) len = left;
+    memcpy(ptr,f->data + f->data_pos,len);
+    f->data_pos += len;
+    return len;
+}
+
+/* read compressed data from file, used by decompressor */
+static size_t
+read_compressed(void *f,BUFFER *ptr,size_t len)
+{
+    return raw_read((struct input_file *) f,ptr,len);
+}
+
+/* read len octets from file, decompress if file is compressed.
+   Uses only the file structure, so this can be called from the I/O thread
+ */
+static size_t
+file_read(struct input_file *f,BUFFER *ptr,size_t len)
+{
+    if(f->decoder != NULL) return decompress_read(f->decoder,ptr,len,read_compressed,f);
+    return raw_read(f,ptr,len);
+}
+
+/* raise the decompression error of current file in the main thread */
+static void
+check_read_error()
+{
+    char *msg;
+
+    if(current_file == NULL || current_file->decoder == NULL) return;
+    msg = decompress_error(current_file->decoder);
+    if(msg != NULL) data_error(msg,NULL,NULL);
+}
+
+/* read len octets from current file */
+static size_t
+input_read(BUFFER *ptr,size_t len)
+{
+    size_t got;
+
+    STATS_TIME(io_time,got = file_read(current_file,ptr,len));
+    stats.bytes_read += (FILE_OFFSET) got;
+    check_read_error();
+    return got;
+}
+
+/* make buffer i the current buffer */
+static void
+use_buffer(int i)
+{
+    current_buffer = i;
+    buffer_start = buffers[i];
+    buffer_end = buffer_start + BUFFER_SIZE;
+    low_water = buffer_end - (BUFFER_SIZE >> 3);    // low water is bufferSize/8 before end
+}
+
+/* allocate the buffer when used first time */
+static void
+buffer_alloc()
+{
+    if(buffers[0] == NULL) 
+    {
+        buffers[0] = xmalloc(BUFFER_SIZE);
+        use_buffer(0);
+    }
+#ifdef USE_READ_AHEAD
+    if(read_ahead && buffers[1] == NULL) buffers[1] = xmalloc(BUFFER_SIZE);
+#endif
+}
+
+#ifdef USE_READ_AHEAD
+/* open the file after file current while the end of current file is parsed
+   so that the file system can start reading it
+ */
+static void
+prefetch_next_file(struct input_file *current)
+{
+    struct input_file *f = current->next;
+
+    if(f == NULL || f->ahead_fp != NULL) return;
+    if(f->name[0] == '-' && f->name[1] == 0) return;
+    if(f->data != NULL || f->pre_state != PRE_UNKNOWN) return;   // already read in batch or given as stream
+
+    f->ahead_fp = fopen(f->name,"rb");                           // errors are reported when file is opened normally
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
+    if(f->ahead_fp != NULL) posix_fadvise(fileno(f->ahead_fp),(off_t) 0,(off_t) 0,POSIX_FADV_WILLNEED);
+#endif
+}
+
+/* I/O thread, reads the requested segment */
+static void *
+read_ahead_thread(void *arg)
+{
+    struct read_ahead *a = arg;
+    size_t got;
+
+    pthread_mutex_lock(&a->mutex);
+    for(;;)
+    {
+        while(a->state != AHEAD_REQUESTED && a->state != AHEAD_QUIT) pthread_cond_wait(&a->cond,&a->mutex);
+        if(a->state == AHEAD_QUIT) break;
+        pthread_mutex_unlock(&a->mutex);
+
+        got = file_read(a->file,a->dst,a->len);
+        if(got < a->len && a->prefetch) prefetch_next_file(a->file);
+
+        pthread_mutex_lock(&a->mutex);
+        a->got = got;
+        a->state = AHEAD_DONE;
+        pthread_cond_broadcast(&a->cond);
+    }
+    pthread_mutex_unlock(&a->mutex);
+    return NULL;
+}
+
+/* start reading next segment to the other buffer */
+static void
+read_ahead_start()
+{
+    int rc;
+
+    if(ahead == NULL)
+    {
+        ahead = xmalloc(sizeof(struct read_ahead));
+        pthread_mutex_init(&ahead->mutex,NULL);
+        pthread_cond_init(&ahead->cond,NULL);
+        ahead->state = AHEAD_IDLE;
+        rc = pthread_create(&ahead->thread,NULL,read_ahead_thread,ahead);
+        if(rc != 0) panic("Cannot create thread",strerror(rc),NULL);
+    }
+
+    pthread_mutex_lock(&ahead->mutex);
+    ahead->file = current_file;
+    ahead->prefetch = tlve_open == NULL || tlve_open[0] == '\000';    // preprocessors are started ahead separately
+    ahead->dst = buffers[1 - current_buffer] + AHEAD_RESERVE;
+    ahead->len = BUFFER_SIZE - AHEAD_RESERVE;
+    ahead->state = AHEAD_REQUESTED;
+    pthread_cond_broadcast(&ahead->cond);
+    pthread_mutex_unlock(&ahead->mutex);
+}
+
+/* stop the I/O thread, it is started again when next read-ahead is requested */
+static void
+read_ahead_stop()
+{
+    if(ahead == NULL) return;
+
+    pthread_mutex_lock(&ahead->mutex);
+    while(ahead->state == AHEAD_REQUESTED) pthread_cond_wait(&ahead->cond,&ahead->mutex);
+    ahead->state = AHEAD_QUIT;
+    pthread_cond_broadcast(&ahead->cond);
+    pthread_mutex_unlock(&ahead->mutex);
+
+    pthread_join(ahead->thread,NULL);
+    pthread_mutex_destroy(&ahead->mutex);
+    pthread_cond_destroy(&ahead->cond);
+    free(ahead);
+    ahead = NULL;
+}
+#endif
+
+/* wait until the segment being read is ready, set segment pointers
+ */
+static void
+read_ahead_wait()
+{
+#ifdef USE_READ_AHEAD
+    if(ahead == NULL) return;
+
+    pthread_mutex_lock(&ahead->mutex);
+    if(ahead->state != AHEAD_IDLE)
+    {
+        if(ahead->state != AHEAD_DONE)
+        {
+            STATS_TIME(io_time,while(ahead->state != AHEAD_DONE) pthread_cond_wait(&ahead->cond,&ahead->mutex));
+        }
+        stats.bytes_read += (FILE_OFFSET) ahead->got;
+        seg_data = ahead->dst;
+        seg_end = ahead->dst + ahead->got;
+        seg_eof = ahead->got < ahead->len;
+        ahead->state = AHEAD_IDLE;
+    }
+    pthread_mutex_unlock(&ahead->mutex);
+#endif
+}
+
+#ifdef USE_READ_AHEAD
+/* flush buffer using the segment read ahead.
+   If the unread data fits before the segment, the buffers are swapped and only the
+   unread data is copied. Otherwise the segment is copied after the unread data
+ */
+static void
+flush_buffer_ahead()
+{
+    size_t tomove,len;
+    BUFFER *other = buffers[1 - current_buffer];
+
+    read_ahead_wait();
+    check_read_error();
+
+    tomove = data_end - new_data;
+    stats.bytes_moved += (FILE_OFFSET) tomove;
 
+    if(tomove <= (size_t) (seg_data - other))
+    {
+        memcpy(seg_data - tomove,new_data,tomove);
+        new_data = seg_data - tomove;
+        data_end = seg_end;
+        seg_data = seg_end;
+        use_buffer(1 - current_buffer);
+    } else
+    {
+        memmove(buffer_start,new_data,tomove);
+        new_data = buffer_start;
+        data_end = buffer_start + tomove;
+        len = seg_end - seg_data;
+        if(len > (size_t) (buffer_end - data_end)) len = buffer_end - data_end;
+        memcpy(data_end,seg_data,len);
+        data_end += len;
+        seg_data += len;
+        if(seg_data == seg_end && !seg_eof && data_end < buffer_end)
+        {
+            len = buffer_end - data_end;
+            data_end += input_read(data_end,len);
+            if(data_end < buffer_end) seg_eof = 1;
+        }
+    }
+
+    data_start = new_data;
+    if(seg_data == seg_end && !seg_eof) read_ahead_start();
+}
+#endif
 
 /* flush buffer
    discard read data, and fill the rest of the buffer with new data
@@ -187,16 +732,29 @@ void
 flush_buffer()
 {
     size_t tomove;
-    if(buffer_start == new_data) return;
+    if(data_start == new_data) return;
     if(data_end < buffer_end) return;
 
+    stats.flushes++;
+
+#ifdef USE_READ_AHEAD
+    if(read_ahead)
+    {
+        flush_buffer_ahead();
+        buffer_flushes++;
+        return;
+    }
+#endif
+
     tomove = data_end - new_data;
+    stats.bytes_moved += (FILE_OFFSET) tomove;
 
     memmove(buffer_start,new_data,tomove);
-    data_end = buffer_start + tomove + uc_fread(buffer_start + tomove,(size_t) 1,(size_t) BUFFER_SIZE - tomove,current_file->fp);
+    data_end = buffer_start + tomove + input_read(buffer_start + tomove,(size_t) BUFFER_SIZE - tomove);
     new_data = buffer_start;
+    data_start = buffer_start;
 
-    buffer_state = S_BUFFER_STALE; 
+    buffer_flushes++;
 }
 
 /* returns true if buffer has good data in address
@@ -204,7 +762,7 @@ flush_buffer()
 inline int
 buffer_address_safe(BUFFER *address)
 {
-    return (address >= buffer_start && address < data_end);
+    return (address >= data_start && address < data_end);
 }
 
 
@@ -216,13 +774,31 @@ buffer_data()
 }
 
 
+/* release the buffers and stop the I/O thread, called at the end of input.
+   Buffers are allocated again if more files are read
+ */
+void
+buffer_free()
+{
+#ifdef USE_READ_AHEAD
+    read_ahead_stop();
+#endif
+    free(buffers[0]);
+    free(buffers[1]);
+    buffers[0] = buffers[1] = NULL;
+    current_buffer = 0;
+    buffer_start = buffer_end = data_start = new_data = data_end = low_water = NULL;
+    seg_data = seg_end = NULL;
+    seg_eof = 1;
+}
+
 /* buffer management */
 /* commands are:
    B_INIT - initialize buffer after opening a file, return 0 if nothing could be read
    B_DESIRED - try to get size data on buffer, return 1 in every case
    B_NEEDED -  try to get size data on buffer, return 1 if success, 0 id not
    B_FLUSH - data in buffer has been used, read more if low_water has been reached
-   B_PRINTED - data in buffer (below new_data) has been printed, so state can be changed to OK
+   B_PRINTED - data in buffer (below new_data) has been printed, so buffer can be flushed
 
    return 1 if ok, 0 if not possible or error
 */
@@ -232,16 +808,30 @@ buffer(int command, size_t size)
     switch(command)
     {
         case B_INIT:
-            if(buffer_start == NULL) 
+            read_ahead_wait();
+            if(current_file->borrowed && current_file->decoder == NULL)     // memory is parsed in place
             {
-                buffer_start = xmalloc(BUFFER_SIZE);
-                buffer_end = buffer_start + BUFFER_SIZE;
-                low_water = buffer_end - (BUFFER_SIZE >> 3);    // low water is bufferSize/8 before end
+                buffer_start = data_start = new_data = current_file->data;
+                data_end = current_file->data + current_file->data_len;
+                buffer_end = data_end + 1;                                  // whole file is in buffer, never flushed
+                low_water = buffer_end;
+                stats.bytes_read += (FILE_OFFSET) current_file->data_len;
+                if(buffer_start == data_end) return 0;
+                break;
             }
-
-            data_end = buffer_start + uc_fread(buffer_start,(size_t) 1,BUFFER_SIZE,current_file->fp);
-            buffer_state = S_BUFFER_OK; 
+            buffer_alloc();
+            use_buffer(current_buffer);
+            data_end = buffer_start + input_read(buffer_start,BUFFER_SIZE);
             new_data = buffer_start;
+            data_start = buffer_start;
+#ifdef USE_READ_AHEAD
+            if(read_ahead)
+            {
+                seg_data = seg_end = buffers[1 - current_buffer] + AHEAD_RESERVE;
+                seg_eof = data_end < buffer_end;
+                if(!seg_eof) read_ahead_start();
+            }
+#endif
             if(buffer_start == data_end) return 0;                   // got nothing, probably empty file
             break;
         case B_DESIRED:
@@ -262,17 +852,18 @@ buffer(int command, size_t size)
             break;
         case B_PRINTED:
             if(new_data >= low_water) flush_buffer();                // flush if sensible
-            buffer_state = S_BUFFER_OK;
             break;
     }
     return 1;
 }
 
-/* return buffer state */
-int
-get_buffer_state()
+/* return the count of buffer flushes, data pointers taken before the
+   count changed may be invalid
+ */
+unsigned long
+buffer_flush_count()
 {
-    return buffer_state;
+    return buffer_flushes;
 }
 
 /* search buffer for a octet */
@@ -362,11 +953,96 @@ is_file_read()
 VOID
 buffer_read(size_t size)
 {
+    if(capturing)
+    {
+        if(capture_len + size > capture_size)
+        {
+            capture_size = 2 * (capture_len + size);
+            capture_data = xrealloc(capture_data,capture_size);
+        }
+        memcpy(capture_data + capture_len,new_data,size);
+        capture_len += size;
+    }
     new_data += size;
     current_file->offset += (FILE_OFFSET) size;
     toffset += (FILE_OFFSET) size;
 }
 
+/* skip size bytes of input without looking at them, the data is not kept in buffer.
+   return the bytes skipped, less than size if the end of file was reached
+ */
+FILE_OFFSET
+buffer_skip(FILE_OFFSET size)
+{
+    FILE_OFFSET left = size;
+    size_t n;
+
+    while(left > (FILE_OFFSET) 0)
+    {
+        n = data_end - new_data;
+        if((FILE_OFFSET) n > left) n = (size_t) left;
+        buffer_read(n);
+        left -= (FILE_OFFSET) n;
+        if(left == (FILE_OFFSET) 0 || data_end < buffer_end) break;       // done or end of file
+        flush_buffer();
+        if(data_end == new_data) break;
+    }
+    return size - left;
+}
+
+/* start or stop copying the read octets of the current file, captured octets are discarded */
+void
+buffer_capture(int on)
+{
+    capturing = on;
+    capture_len = 0;
+    capture_offset = current_file->offset;
+}
+
+/* forget the captured octets before file offset */
+void
+buffer_capture_drop(FILE_OFFSET offset)
+{
+    size_t n;
+
+    if(offset <= capture_offset) return;
+    n = offset - capture_offset < (FILE_OFFSET) capture_len ? (size_t) (offset - capture_offset) : capture_len;
+    memmove(capture_data,capture_data + n,capture_len - n);
+    capture_len -= n;
+    capture_offset += (FILE_OFFSET) n;
+}
+
+/* return the captured octets starting from file offset, length is stored in len */
+BUFFER *
+buffer_captured(FILE_OFFSET offset,size_t *len)
+{
+    if(offset < capture_offset || offset - capture_offset > (FILE_OFFSET) capture_len)
+    {
+        *len = 0;
+        return capture_data;
+    }
+    *len = capture_len - (size_t) (offset - capture_offset);
+    return capture_data + (offset - capture_offset);
+}
+
+/* return the descriptor of the current file if the file is a regular file
+   read as it is, so that file offsets are offsets in the descriptor. Otherwise return -1
+ */
+int
+buffer_input_fd()
+{
+#ifdef HAVE_SYS_STAT_H
+    struct stat st;
+
+    if(current_file->fp == NULL || current_file->fp == stdin || current_file->decoder != NULL ||
+       current_file->data != NULL || current_file->pre_state == PRE_STARTED) return -1;
+    if(fstat(fileno(current_file->fp),&st) != 0 || !S_ISREG(st.st_mode)) return -1;
+    return fileno(current_file->fp);
+#else
+    return -1;
+#endif
+}
+
 /* move pointer forward for peeking the next value */
 VOID
 buffer_ahead()
@@ -382,6 +1058,124 @@ buffer_back()
 }
 
 
+/* set the number of input files to be skipped before the first file is opened
+ */
+void
+set_input_file_skip(int count)
+{
+    skip_files = count;
+}
+
+/* return the index of the current file in input file list, first is 0 */
+int
+get_current_file_index()
+{
+    register struct input_file *f = files;
+    int i = 0;
+
+    while(f != NULL && f != current_file)
+    {
+        f = f->next;
+        i++;
+    }
+    return i;
+}
+
+/* move the read point of the current file to offset, must be called before B_INIT.
+   Seekable files are positioned directly, others (pipes, preprocessor output) are read and discarded.
+   total is the new total offset
+ */
+void
+buffer_seek(FILE_OFFSET offset,FILE_OFFSET total)
+{
+    FILE_OFFSET left = offset;
+    size_t toread,got;
+
+#ifdef HAVE_FSEEKO
+    if(current_file->decoder == NULL && current_file->data == NULL && fseeko(current_file->fp,(off_t) offset,SEEK_SET) == 0)
+    {
+        left = (FILE_OFFSET) 0;
+        current_file->peek_len = 0;
+    }
+#endif
+
+    if(left > (FILE_OFFSET) 0) buffer_alloc();
+
+    while(left > (FILE_OFFSET) 0)
+    {
+        toread = left > (FILE_OFFSET) BUFFER_SIZE ? BUFFER_SIZE : (size_t) left;
+        got = input_read(buffer_start,toread);
+        if(got == 0) panic("Input file is shorter than the saved offset",current_file->name,NULL);
+        left -= (FILE_OFFSET) got;
+    }
+
+    current_file->offset = offset;
+    toffset = total;
+}
+
+/* position of file f in octets of the file, compressed files are counted in compressed octets */
+static FILE_OFFSET
+input_position(struct input_file *f)
+{
+    off_t pos;
+
+    if(f->decoder == NULL) return f->offset;
+    if(f->data != NULL) return (FILE_OFFSET) f->data_pos;
+#ifdef HAVE_FSEEKO
+    if(f->fp != NULL && (pos = ftello(f->fp)) >= (off_t) 0) return (FILE_OFFSET) pos;
+#endif
+    return f->offset;
+}
+
+/* return octets of input done and total size of input files for progress reports.
+   Total is -1 if the size of some file is not known (stdin, pipes)
+ */
+void
+input_progress(FILE_OFFSET *done,FILE_OFFSET *total)
+{
+    struct input_file *f;
+    struct stat st;
+    int before = current_file != NULL;
+
+    *done = (FILE_OFFSET) 0;
+    *total = (FILE_OFFSET) 0;
+
+    for(f = files;f != NULL;f = f->next)
+    {
+        if(f->size == (FILE_OFFSET) -2)
+        {
+            if(f->borrowed)
+            {
+                f->size = (FILE_OFFSET) f->data_len;
+            } else if(strcmp(f->name,"-") != 0 && strcmp(f->name,"stdin") != 0 && 
+                      stat(f->name,&st) == 0 && S_ISREG(st.st_mode))
+            {
+                f->size = (FILE_OFFSET) st.st_size;
+            } else
+            {
+                f->size = (FILE_OFFSET) -1;
+            }
+        }
+
+        if(f == current_file)
+        {
+            *done += input_position(f);
+            before = 0;
+        } else if(before && f->size > (FILE_OFFSET) 0)
+        {
+            *done += f->size;
+        }
+
+        if(f->size < (FILE_OFFSET) 0)
+        {
+            *total = (FILE_OFFSET) -1;
+        } else if(*total >= (FILE_OFFSET) 0)
+        {
+            *total += f->size;
+        }
+    }
+}
+
 /* current file */
 char *
 get_current_file_name()
@@ -412,6 +1206,16 @@ buffer_eof()
 }
 
 
+/* return the offset of the last error in current file and forget it, -1 if there was no error */
+FILE_OFFSET
+buffer_error_offset()
+{
+    FILE_OFFSET offset = error_offset;
+
+    error_offset = (FILE_OFFSET) -1;
+    return offset;
+}
+
 /* buffer could not be read, e.g. there was not enough data for tag to read */
 void
 buffer_error(char *message,struct tlvitem *e)
@@ -420,7 +1224,14 @@ buffer_error(char *message,struct tlvitem *e)
     char *file = "tlve.debug";
     FILE *fp;
 
-    if(message) fprintf(stderr,"%s: %s, in file '%s', offset %lld\n",program_name,message,current_file->name,(long long int) current_file->offset - (long long int) (e ? e->raw_tl_length : 0));
+    char where[256];
+
+    error_offset = e ? e->file_offset : current_file->offset;      // error is reported at the start of the element header
+    snprintf(where,sizeof(where),"in file '%s', offset %lld",current_file->name,(long long int) error_offset);
+
+    if(data_error_is_caught()) data_error(message != NULL ? message : "Processing error",where,NULL);   // caller reports the error
+
+    if(message) fprintf(stderr,"%s: %s, %s\n",program_name,message,where);
 
     if(debug)
     {
@@ -444,6 +1255,7 @@ buffer_error(char *message,struct tlvitem *e)
                 ,(unsigned int) buffer_unread());
         
         if(e->raw_tl_length + e->raw_value_length < pl) pl = e->raw_tl_length + e->raw_value_length;
+        if(!pl) pl = buffer_unread() < 10 ? buffer_unread() : 10;       // tag-length was not read, dump the data at the header
         fprintf(stderr," %s\n",print_list_hex_dump(e->raw_tl,pl));
 
     }
@@ -0,0 +1,400 @@
+/* 
+   tlve - A program to parse tag-length-value structures and print them in different formats
+
+   Copyright (C) 2009 Timo Savinen
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.  
+*/ 
+#include "tlve.h"
+
+/* Checkpoint file contains the parser state at a point where all read data has been printed:
+   input file and offsets, level stack, current path, hold values and the constructors
+   waiting for their level trailers. Using this state the processing can be continued from
+   the saved offset.
+ */
+
+#define CHECKPOINT_ID "tlve-checkpoint"
+#define CHECKPOINT_VERSION 1
+
+/* default interval between checkpoints in input bytes */
+#define CHECKPOINT_INTERVAL ((FILE_OFFSET) 64 * 1024 * 1024)
+
+/* checkpoint file name, NULL if checkpoints are not used */
+static TLS char *checkpoint_file = NULL;
+
+/* bytes of input between checkpoints */
+static TLS FILE_OFFSET checkpoint_interval = CHECKPOINT_INTERVAL;
+
+/* total offset when the next checkpoint should be written */
+static TLS FILE_OFFSET next_checkpoint = CHECKPOINT_INTERVAL;
+
+/* checkpoint file to be restored, NULL if nothing to restore */
+static TLS FILE *resume_fp = NULL;
+
+/* saved offsets of the file to be resumed */
+static TLS FILE_OFFSET resume_file_offset;
+static TLS FILE_OFFSET resume_total_offset;
+static TLS char *resume_file_name = NULL;
+
+void
+checkpoint_set_file(char *name)
+{
+    checkpoint_file = xstrdup(name);
+}
+
+void
+checkpoint_set_interval(FILE_OFFSET interval)
+{
+    if(interval <= (FILE_OFFSET) 0) panic("Checkpoint interval must be greater than zero",NULL,NULL);
+    checkpoint_interval = interval;
+    next_checkpoint = interval;
+}
+
+static void
+checkpoint_panic(char *msg)
+{
+    panic("Invalid checkpoint file",checkpoint_file,msg);
+}
+
+/* write a string as length:bytes, NULL is written as - */
+static void
+write_string(FILE *fp,char *s)
+{
+    if(s == NULL)
+    {
+        fputs(" -",fp);
+    } else
+    {
+        fprintf(fp," %lu:",(unsigned long) strlen(s));
+        fputs(s,fp);
+    }
+}
+
+/* read a string written by write_string */
+static char *
+read_string(FILE *fp)
+{
+    unsigned long len;
+    char *s;
+    int c;
+
+    do
+    {
+        c = getc(fp);
+    } while(c == ' ');
+
+    if(c == '-') return NULL;
+    ungetc(c,fp);
+
+    if(fscanf(fp,"%lu:",&len) != 1) checkpoint_panic("string expected");
+
+    s = xmalloc((size_t) len + 1);
+    if(fread(s,(size_t) 1,(size_t) len,fp) != (size_t) len) checkpoint_panic("string too short");
+    s[len] = 0;
+    return s;
+}
+
+/* read a keyword and check that it is the expected one */
+static void
+expect(FILE *fp,char *keyword)
+{
+    char word[64];
+
+    if(fscanf(fp," %63s",word) != 1 || strcmp(word,keyword) != 0) checkpoint_panic(keyword);
+}
+
+/* read a signed number */
+static FILE_OFFSET
+read_number(FILE *fp)
+{
+    long long int n;
+
+    if(fscanf(fp," %lld",&n) != 1) checkpoint_panic("number expected");
+    return (FILE_OFFSET) n;
+}
+
+/* return the index of tlv definition in structure, -1 if not found */
+static int
+tlvdef_index(struct tlvdef *tlv)
+{
+    register struct tlvlist *t = structure.tlv;
+    int i = 0;
+
+    while(t != NULL)
+    {
+        if(t->tlv == tlv) return i;
+        t = t->next;
+        i++;
+    }
+    return -1;
+}
+
+/* return tlv definition using index, NULL if index is -1 */
+static struct tlvdef *
+tlvdef_by_index(int index)
+{
+    register struct tlvlist *t = structure.tlv;
+
+    if(index < 0) return NULL;
+
+    while(t != NULL && index--) t = t->next;
+    if(t == NULL) checkpoint_panic("tlv definition not found");
+    return t->tlv;
+}
+
+/* return tl definition using name */
+static struct tldef *
+tldef_by_name(char *name)
+{
+    register struct tldef *t = tl;
+
+    while(t != NULL)
+    {
+        if(name != NULL && strcmp(t->name,name) == 0) return t;
+        t = t->next;
+    }
+    checkpoint_panic("tag-length definition not found");
+    return NULL;
+}
+
+/* write the parser state to checkpoint file.
+   File is written to a temporary file first and then renamed, so there is always one valid checkpoint
+ */
+static void
+checkpoint_write()
+{
+    char *tmp;
+    FILE *fp;
+    struct level *l;
+    struct hold *h;
+    struct tlvitem *item;
+    int i,count;
+    FILE_OFFSET output_offset;
+
+    output_offset = print_list_output_offset();    // make sure that printed data is in output before saving the state
+
+    tmp = xmalloc(strlen(checkpoint_file) + 5);
+    strcpy(tmp,checkpoint_file);
+    strcat(tmp,".tmp");
+
+    fp = xfopen(tmp,"w",'b');
+
+    fprintf(fp,"%s %d\n",CHECKPOINT_ID,CHECKPOINT_VERSION);
+    fputs("structure",fp);
+    write_string(fp,structure.name);
+    fprintf(fp,"\nfile %d %lld",get_current_file_index(),(long long int) file_offset());
+    write_string(fp,get_current_file_name());
+    fprintf(fp,"\ntotal %lld\n",(long long int) total_offset());
+    fprintf(fp,"output %lld\n",(long long int) output_offset);
+
+    fprintf(fp,"levels %d\n",get_current_level());
+    for(i = FIRST_LEVEL;i <= get_current_level();i++)
+    {
+        l = get_level(i);
+        fprintf(fp,"level %u %lld",l->form,(long long int) l->size);
+        write_string(fp,l->content_tl->name);
+        fputc('\n',fp);
+    }
+
+    fprintf(fp,"path %d\n",print_list_path_level());
+    for(i = 0;i < print_list_path_level();i++)
+    {
+        fputs("name",fp);
+        write_string(fp,print_list_path_name(i));
+        fputc('\n',fp);
+    }
+
+    count = 0;
+    for(h = hold;h != NULL;h = h->next) count++;
+    fprintf(fp,"holds %d\n",count);
+    for(h = hold;h != NULL;h = h->next)
+    {
+        fputs("hold",fp);
+        write_string(fp,h->buffer);
+        fputc('\n',fp);
+    }
+
+    count = 0;
+    while(print_list_open_constructor(count) != NULL) count++;
+    fprintf(fp,"items %d\n",count);
+    for(i = 0;i < count;i++)
+    {
+        item = print_list_open_constructor(i);
+        fprintf(fp,"item %u %u %u %lld %lld %lld %lu %lu %d",item->level,item->tlv_type,item->form,(long long int) item->length,
+                (long long int) item->file_offset,(long long int) item->total_offset,(unsigned long) item->raw_tl_length,
+                (unsigned long) item->raw_value_length,tlvdef_index(item->tlv));
+        write_string(fp,item->tl->name);
+        write_string(fp,item->tag);
+        write_string(fp,item->type);
+        fputc('\n',fp);
+    }
+    fputs("end\n",fp);
+
+    if(fflush(fp) != 0) panic("Error writing checkpoint file",tmp,strerror(errno));
+#ifdef HAVE_FSYNC
+    fsync(fileno(fp));
+#endif
+    if(fclose(fp) != 0) panic("Error writing checkpoint file",tmp,strerror(errno));
+#ifdef HAVE_RENAME
+    if(rename(tmp,checkpoint_file) != 0) panic("Cannot rename checkpoint file",tmp,strerror(errno));
+#else
+    panic("Checkpoints are not supported in this system",NULL,NULL);
+#endif
+    free(tmp);
+}
+
+/* read the checkpoint file header, set up the input files to be resumed.
+   returns the output offset to continue from, -1 if not known.
+   If checkpoint file does not exists, nothing is resumed
+ */
+FILE_OFFSET
+checkpoint_load()
+{
+    int version,index;
+    char *sname;
+    FILE_OFFSET output_offset;
+
+    if(checkpoint_file == NULL) panic("Checkpoint file must be given when resuming",NULL,NULL);
+
+    resume_fp = fopen(checkpoint_file,"r");
+    if(resume_fp == NULL)
+    {
+        if(errno == ENOENT) return (FILE_OFFSET) -1;          // nothing to resume, start from beginning
+        panic("Error in opening file",checkpoint_file,strerror(errno));
+    }
+
+    expect(resume_fp,CHECKPOINT_ID);
+    if(fscanf(resume_fp," %d",&version) != 1 || version != CHECKPOINT_VERSION) checkpoint_panic("unknown version");
+
+    expect(resume_fp,"structure");
+    sname = read_string(resume_fp);
+    if(sname == NULL || STRCMP(sname,structure.name) != 0) panic("Checkpoint was written using different structure",sname,NULL);
+
+    expect(resume_fp,"file");
+    index = (int) read_number(resume_fp);
+    resume_file_offset = read_number(resume_fp);
+    resume_file_name = read_string(resume_fp);
+    expect(resume_fp,"total");
+    resume_total_offset = read_number(resume_fp);
+    expect(resume_fp,"output");
+    output_offset = read_number(resume_fp);
+
+    set_input_file_skip(index);
+    next_checkpoint = resume_total_offset + checkpoint_interval;
+
+    return output_offset;
+}
+
+/* restore the parser state for the first opened file,
+   returns true if state was restored
+ */
+int
+checkpoint_restore()
+{
+    int i,count;
+    struct level *l;
+    struct hold *h;
+    struct tlvitem item;
+
+    if(resume_fp == NULL) return 0;
+
+    if(resume_file_name == NULL || strcmp(resume_file_name,get_current_file_name()) != 0)
+        panic("Checkpoint does not match the input files",resume_file_name,NULL);
+
+    expect(resume_fp,"levels");
+    count = (int) read_number(resume_fp);
+    for(i = FIRST_LEVEL;i <= count;i++)
+    {
+        set_current_level(i);
+        l = get_level(i);
+        expect(resume_fp,"level");
+        l->form = (TYPE) read_number(resume_fp);
+        l->size = read_number(resume_fp);
+        l->content_tl = tldef_by_name(read_string(resume_fp));
+    }
+
+    expect(resume_fp,"path");
+    count = (int) read_number(resume_fp);
+    for(i = 0;i < count;i++)
+    {
+        expect(resume_fp,"name");
+        print_list_push_path(read_string(resume_fp));
+    }
+
+    expect(resume_fp,"holds");
+    count = (int) read_number(resume_fp);
+    for(i = 0,h = hold;i < count;i++)
+    {
+        if(h == NULL) checkpoint_panic("hold list does not match");
+        expect(resume_fp,"hold");
+        h->buffer = read_string(resume_fp);
+        h = h->next;
+    }
+
+    expect(resume_fp,"items");
+    count = (int) read_number(resume_fp);
+    for(i = 0;i < count;i++)
+    {
+        expect(resume_fp,"item");
+        item.level = (unsigned int) read_number(resume_fp);
+        item.tlv_type = (TYPE) read_number(resume_fp);
+        item.form = (TYPE) read_number(resume_fp);
+        item.length = read_number(resume_fp);
+        item.file_offset = read_number(resume_fp);
+        item.total_offset = read_number(resume_fp);
+        item.raw_tl_length = (size_t) read_number(resume_fp);
+        item.raw_value_length = (size_t) read_number(resume_fp);
+        item.tlv = tlvdef_by_index((int) read_number(resume_fp));
+        item.tl = tldef_by_name(read_string(resume_fp));
+        strncpy(item.tag,read_string(resume_fp),MAX_TAG_SIZE - 1);
+        item.tag[MAX_TAG_SIZE - 1] = 0;
+        strncpy(item.type,read_string(resume_fp),MAX_TAG_SIZE - 1);
+        item.type[MAX_TAG_SIZE - 1] = 0;
+        item.raw_tl = NULL;
+        item.raw_value = NULL;
+        item.converted_value = "";
+        item.converted_value_len = 1;
+        print_list_restore_constructor(&item);
+    }
+
+    expect(resume_fp,"end");
+    fclose(resume_fp);
+    resume_fp = NULL;
+
+    buffer_seek(resume_file_offset,resume_total_offset);
+    return 1;
+}
+
+/* write checkpoint if enough data has been read since the last one,
+   checkpoint is written only when all read data has been printed
+ */
+void
+checkpoint_check()
+{
+    if(checkpoint_file == NULL) return;
+    if(total_offset() < next_checkpoint) return;
+    if(print_list_pending()) return;
+
+    checkpoint_write();
+    next_checkpoint = total_offset() + checkpoint_interval;
+}
+
+/* all input has been processed, checkpoint is not needed any more */
+void
+checkpoint_done()
+{
+    if(checkpoint_file == NULL) return;
+    if(unlink(checkpoint_file) != 0 && errno != ENOENT) panic("Cannot remove checkpoint file",checkpoint_file,strerror(errno));
+}
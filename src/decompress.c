@@ -0,0 +1,326 @@
+/* 
+   tlve - A program to parse tag-length-value structures and print them in different formats
+
+   Copyright (C) 2009 Timo Savinen
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.  
+*/ 
+#include "tlve.h"
+
+/* In-process decompression of input files. Compression is recognized using
+   the magic bytes in the beginning of the file
+ */
+
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ)
+#define USE_GZIP 1
+#include <zlib.h>
+#endif
+
+#if defined(HAVE_BZLIB_H) && defined(HAVE_LIBBZ2)
+#define USE_BZIP2 1
+#include <bzlib.h>
+#endif
+
+#if defined(HAVE_ZSTD_H) && defined(HAVE_LIBZSTD)
+#define USE_ZSTD 1
+#include <zstd.h>
+#endif
+
+/* size of buffer for compressed data */
+#define COMPRESSED_SIZE ((size_t) 262144)
+
+struct decompressor
+{
+    int type;                    // D_GZIP, D_BZIP2 or D_ZSTD
+    char *name;                  // name of the file for error messages
+    BUFFER *in;                  // compressed data
+    size_t in_len;               // bytes in in
+    size_t in_pos;               // next unused byte in in
+    int in_eof;                  // compressed input exhausted
+    int stream_end;              // end of compressed stream reached, new stream may follow
+    char error[256];             // message of an error in decompression, empty if none
+    int error_reported;          // error has been returned by decompress_error
+#ifdef USE_GZIP
+    z_stream z;
+#endif
+#ifdef USE_BZIP2
+    bz_stream bz;
+#endif
+#ifdef USE_ZSTD
+    ZSTD_DStream *zstd;
+#endif
+};
+
+/* magic bytes for compression types */
+#ifdef USE_GZIP
+static BUFFER gzip_magic[] = {0x1f,0x8b};
+#endif
+#ifdef USE_BZIP2
+static BUFFER bzip2_magic[] = {'B','Z','h'};
+#endif
+#ifdef USE_ZSTD
+static BUFFER zstd_magic[] = {0x28,0xb5,0x2f,0xfd};
+#endif
+
+/* return compression type for data starting with magic,
+   D_NONE if the data is not compressed or the compression is not supported
+ */
+int
+decompress_type(BUFFER *magic,size_t len)
+{
+#ifdef USE_GZIP
+    if(len >= sizeof(gzip_magic) && memcmp(magic,gzip_magic,sizeof(gzip_magic)) == 0) return D_GZIP;
+#endif
+#ifdef USE_BZIP2
+    if(len >= sizeof(bzip2_magic) + 1 && memcmp(magic,bzip2_magic,sizeof(bzip2_magic)) == 0 &&
+       magic[3] >= '1' && magic[3] <= '9') return D_BZIP2;
+#endif
+#ifdef USE_ZSTD
+    if(len >= sizeof(zstd_magic) && memcmp(magic,zstd_magic,sizeof(zstd_magic)) == 0) return D_ZSTD;
+#endif
+    return D_NONE;
+}
+
+/* Save the error message, decompression can be run in the I/O thread so the
+   error is raised by the reader, see decompress_error
+ */
+static void
+decompress_fail(struct decompressor *d,char *msg,char *syserror)
+{
+    if(d->error[0]) return;
+    if(syserror != NULL)
+    {
+        snprintf(d->error,sizeof(d->error),"%s: %s; %s",msg,d->name,syserror);
+    } else
+    {
+        snprintf(d->error,sizeof(d->error),"%s: %s",msg,d->name);
+    }
+}
+
+/* initialize the decompression stream */
+static void
+decompress_init(struct decompressor *d)
+{
+    switch(d->type)
+    {
+#ifdef USE_GZIP
+        case D_GZIP:
+            d->z.zalloc = Z_NULL;
+            d->z.zfree = Z_NULL;
+            d->z.opaque = Z_NULL;
+            d->z.next_in = Z_NULL;
+            d->z.avail_in = 0;
+            if(inflateInit2(&d->z,15 + 16) != Z_OK) decompress_fail(d,"Cannot initialize decompression",d->z.msg);
+            break;
+#endif
+#ifdef USE_BZIP2
+        case D_BZIP2:
+            d->bz.bzalloc = NULL;
+            d->bz.bzfree = NULL;
+            d->bz.opaque = NULL;
+            if(BZ2_bzDecompressInit(&d->bz,0,0) != BZ_OK) decompress_fail(d,"Cannot initialize decompression",NULL);
+            break;
+#endif
+#ifdef USE_ZSTD
+        case D_ZSTD:
+            d->zstd = ZSTD_createDStream();
+            if(d->zstd == NULL) decompress_fail(d,"Cannot initialize decompression",NULL);
+            ZSTD_initDStream(d->zstd);
+            break;
+#endif
+    }
+}
+
+/* open a decompressor for a file */
+struct decompressor *
+decompress_open(int type,char *name)
+{
+    struct decompressor *d;
+
+    d = xmalloc(sizeof(struct decompressor));
+
+    d->type = type;
+    d->name = name;
+    d->in = xmalloc(COMPRESSED_SIZE);
+    d->in_len = 0;
+    d->in_pos = 0;
+    d->in_eof = 0;
+    d->stream_end = 0;
+    d->error[0] = 0;
+    d->error_reported = 0;
+
+    decompress_init(d);
+    if(d->error[0]) panic(d->error,NULL,NULL);
+    return d;
+}
+
+/* end the decompression stream */
+static void
+decompress_end(struct decompressor *d)
+{
+    switch(d->type)
+    {
+#ifdef USE_GZIP
+        case D_GZIP:
+            inflateEnd(&d->z);
+            break;
+#endif
+#ifdef USE_BZIP2
+        case D_BZIP2:
+            BZ2_bzDecompressEnd(&d->bz);
+            break;
+#endif
+#ifdef USE_ZSTD
+        case D_ZSTD:
+            ZSTD_freeDStream(d->zstd);
+            break;
+#endif
+    }
+}
+
+/* release the decompressor */
+void
+decompress_close(struct decompressor *d)
+{
+    decompress_end(d);
+    free(d->in);
+    free(d);
+}
+
+/* run decompression from d->in to out, return the bytes written to out
+ */
+static size_t
+decompress_block(struct decompressor *d,BUFFER *out,size_t len)
+{
+    size_t written = 0;
+    int rc;
+
+    switch(d->type)
+    {
+#ifdef USE_GZIP
+        case D_GZIP:
+            d->z.next_in = d->in + d->in_pos;
+            d->z.avail_in = (uInt) (d->in_len - d->in_pos);
+            d->z.next_out = out;
+            d->z.avail_out = (uInt) len;
+            rc = inflate(&d->z,Z_NO_FLUSH);
+            if(rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR)
+            {
+                decompress_fail(d,"Decompression error",d->z.msg);
+                return 0;
+            }
+            if(rc == Z_STREAM_END) d->stream_end = 1;
+            d->in_pos = d->in_len - d->z.avail_in;
+            written = len - d->z.avail_out;
+            break;
+#endif
+#ifdef USE_BZIP2
+        case D_BZIP2:
+            d->bz.next_in = (char *) d->in + d->in_pos;
+            d->bz.avail_in = (unsigned int) (d->in_len - d->in_pos);
+            d->bz.next_out = (char *) out;
+            d->bz.avail_out = (unsigned int) len;
+            rc = BZ2_bzDecompress(&d->bz);
+            if(rc != BZ_OK && rc != BZ_STREAM_END)
+            {
+                decompress_fail(d,"Decompression error",NULL);
+                return 0;
+            }
+            if(rc == BZ_STREAM_END) d->stream_end = 1;
+            d->in_pos = d->in_len - d->bz.avail_in;
+            written = len - d->bz.avail_out;
+            break;
+#endif
+#ifdef USE_ZSTD
+        case D_ZSTD:
+            {
+                ZSTD_inBuffer zin;
+                ZSTD_outBuffer zout;
+                size_t zrc;
+
+                zin.src = d->in;
+                zin.size = d->in_len;
+                zin.pos = d->in_pos;
+                zout.dst = out;
+                zout.size = len;
+                zout.pos = 0;
+                zrc = ZSTD_decompressStream(d->zstd,&zout,&zin);
+                if(ZSTD_isError(zrc))
+                {
+                    decompress_fail(d,"Decompression error",(char *) ZSTD_getErrorName(zrc));
+                    return 0;
+                }
+                if(zrc == 0) d->stream_end = 1;
+                d->in_pos = zin.pos;
+                written = zout.pos;
+            }
+            break;
+#endif
+    }
+    return written;
+}
+
+/* read decompressed data, compressed data is read using function source, source_arg
+   is given as the first argument to source.
+   Reads len bytes unless the end of the data is reached or an error occurs, returns the bytes read.
+   Errors are not raised here, caller must check them with decompress_error.
+   Concatenated compressed streams are read as one stream
+ */
+size_t
+decompress_read(struct decompressor *d,BUFFER *out,size_t len,size_t (*source)(void *,BUFFER *,size_t),void *source_arg)
+{
+    size_t total = 0;
+    size_t got;
+
+    while(total < len && !d->error[0])
+    {
+        if(d->in_pos == d->in_len && !d->in_eof)
+        {
+            d->in_len = source(source_arg,d->in,COMPRESSED_SIZE);
+            d->in_pos = 0;
+            if(d->in_len == 0) d->in_eof = 1;
+        }
+
+        if(d->stream_end)
+        {
+            if(d->in_pos == d->in_len && d->in_eof) break;
+            if(d->in_pos < d->in_len)            // next stream follows
+            {
+                decompress_end(d);
+                decompress_init(d);
+                d->stream_end = 0;
+                if(d->error[0]) break;
+            }
+            continue;
+        }
+
+        got = decompress_block(d,out + total,len - total);
+        total += got;
+
+        if(!got && d->in_eof && d->in_pos == d->in_len && !d->stream_end) decompress_fail(d,"Compressed file is truncated",NULL);
+    }
+    return total;
+}
+
+/* return the message of decompression error, NULL if there was no error.
+   The error is returned only once, after that the stream looks like it has ended
+ */
+char *
+decompress_error(struct decompressor *d)
+{
+    if(!d->error[0] || d->error_reported) return NULL;
+    d->error_reported = 1;
+    return d->error;
+}
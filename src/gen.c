@@ -0,0 +1,673 @@
+/* 
+   tlve - A program to parse tag-length-value structures and print them in different formats
+
+   Copyright (C) 2009 Timo Savinen
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.  
+*/ 
+#include "tlve.h"
+
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+
+/* Synthetic input generator for benchmarks. Elements are generated using the
+   tag-length and tlv definitions of a structure in configuration file.
+
+   Tags are selected randomly from the tlv definitions of the structure. For BER tags
+   definitions having a value type are primitive and others may be constructed,
+   for other tag types definitions having type=constructed are constructed.
+   Values are generated according to the value type of the definition.
+
+   Output is the same for the same seed and options.
+ */
+
+#define EXIT_FAILURE 1
+#define EXIT_SUCCESS 0
+
+/* probability (percent) that an element is constructed if it is possible */
+#define CONSTRUCTED_PCT 40
+
+static char short_opts[] = "c:s:o:S:d:w:i:u:v:r:h";
+
+#ifdef HAVE_GETOPT_LONG
+static struct option long_opts[] =
+{
+  {"configuration", 1, 0, 'c'},
+  {"structure", 1, 0, 's'},
+  {"output", 1, 0, 'o'},
+  {"size", 1, 0, 'S'},
+  {"depth", 1, 0, 'd'},
+  {"width", 1, 0, 'w'},
+  {"indefinite", 1, 0, 'i'},
+  {"unknown", 1, 0, 'u'},
+  {"value-size", 1, 0, 'v'},
+  {"seed", 1, 0, 'r'},
+  {"help", 0, 0, 'h'},
+  {NULL, 0, NULL, 0}
+};
+#endif
+
+/* generated data */
+struct out
+{
+    BUFFER *data;
+    size_t len;
+    size_t size;
+};
+
+/* generation parameters */
+static FILE_OFFSET total_size = 1024 * 1024;
+static int max_depth = 6;
+static int max_width = 8;
+static int indefinite_pct = 0;
+static int unknown_pct = 5;
+static size_t value_size = 16;
+static unsigned long long seed = 1;
+
+static FILE_OFFSET elements = 0;
+
+/* tlv definitions usable as primitive and constructed elements */
+static struct tlvdef **primitives = NULL;
+static int primitive_count = 0;
+static struct tlvdef **constructors = NULL;
+static int constructor_count = 0;
+
+/* random number from 0 to n - 1, xorshift64* */
+static unsigned long
+rnd(unsigned long n)
+{
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+    return (unsigned long) ((seed * 2685821657736338717ULL) >> 33) % n;
+}
+
+static void
+out_put(struct out *o,void *data,size_t len)
+{
+    if(o->len + len > o->size)
+    {
+        o->size = 2 * (o->len + len);
+        o->data = xrealloc(o->data,o->size);
+    }
+    memcpy(o->data + o->len,data,len);
+    o->len += len;
+}
+
+static void
+out_putc(struct out *o,BUFFER c)
+{
+    out_put(o,&c,1);
+}
+
+/* write integer value using length octets */
+static void
+put_int(struct out *o,struct bo *bo,unsigned long long value)
+{
+    size_t i;
+
+    for(i = 0;i < bo->length;i++)
+    {
+        if(bo->type == T_INTLE || bo->type == T_UINTLE)
+        {
+            out_putc(o,(BUFFER) (value >> (8 * i)));
+        } else
+        {
+            out_putc(o,(BUFFER) (value >> (8 * (bo->length - i - 1))));
+        }
+    }
+}
+
+/* write string, fixed length strings are padded with spaces */
+static void
+put_string(struct out *o,struct bo *bo,char *s)
+{
+    size_t len = strlen(s);
+
+    if(bo->use_terminator)
+    {
+        out_put(o,s,len);
+        out_putc(o,(BUFFER) bo->terminator);
+    } else
+    {
+        if(len > bo->length) len = bo->length;
+        out_put(o,s,len);
+        while(len++ < bo->length) out_putc(o,' ');
+    }
+}
+
+static void
+check_bo(struct bo *bo)
+{
+    if(bo->mask || bo->shift || bo->use_offset) panic("Generator does not support mask, shift or offset in tag or length",NULL,NULL);
+}
+
+/* write tag */
+static void
+put_tag(struct out *o,struct bo *bo,char *tag,int constructed)
+{
+    unsigned long long n;
+    BUFFER c = 0,b[16];
+    int i = 0;
+
+    check_bo(bo);
+
+    switch(bo->type)
+    {
+        case T_BER:
+            switch(tag[0])
+            {
+                case 'A':
+                    c = 0x40;
+                    break;
+                case 'C':
+                    c = 0x80;
+                    break;
+                case 'P':
+                    c = 0xc0;
+                    break;
+            }
+            if(constructed) c |= 0x20;
+            n = strtoull(tag + 2,NULL,10);
+            if(n < 31)
+            {
+                out_putc(o,c | (BUFFER) n);
+            } else
+            {
+                out_putc(o,c | 0x1f);
+                do
+                {
+                    b[i++] = (BUFFER) (n & 0x7f);
+                    n >>= 7;
+                } while(n);
+                while(i--) out_putc(o,b[i] | (i ? 0x80 : 0));
+            }
+            break;
+        case T_INTBE:
+        case T_INTLE:
+        case T_UINTBE:
+        case T_UINTLE:
+            put_int(o,bo,strtoull(tag,NULL,10));
+            break;
+        case T_STRING:
+            put_string(o,bo,tag);
+            break;
+    }
+}
+
+/* write length, indefinite length only for BER */
+static void
+put_length(struct out *o,struct bo *bo,FILE_OFFSET length,int indefinite)
+{
+    BUFFER b[16];
+    char s[32];
+    int i = 0;
+
+    check_bo(bo);
+
+    switch(bo->type)
+    {
+        case T_BER:
+            if(indefinite)
+            {
+                out_putc(o,0x80);
+            } else if(length < 128)
+            {
+                out_putc(o,(BUFFER) length);
+            } else
+            {
+                do
+                {
+                    b[i++] = (BUFFER) (length & 0xff);
+                    length >>= 8;
+                } while(length);
+                out_putc(o,(BUFFER) (0x80 | i));
+                while(i--) out_putc(o,b[i]);
+            }
+            break;
+        case T_INTBE:
+        case T_INTLE:
+        case T_UINTBE:
+        case T_UINTLE:
+            put_int(o,bo,(unsigned long long) length);
+            break;
+        case T_STRING:
+            if(bo->use_terminator)
+            {
+                sprintf(s,"%llu",(unsigned long long) length);
+            } else
+            {
+                sprintf(s,"%0*llu",(int) bo->length,(unsigned long long) length);
+            }
+            put_string(o,bo,s);
+            break;
+    }
+}
+
+/* write tag and length of an element having value of length value_len */
+static void
+put_tl(struct out *o,struct tldef *t,char *tag,int constructed,size_t value_len,int indefinite)
+{
+    struct out tlo = {NULL,0,0};
+    FILE_OFFSET length = value_len;
+    size_t tag_len;
+    int i;
+
+    if(t->type != NULL) panic("Generator does not support type in tag-length definition",t->name,NULL);
+
+    put_tag(&tlo,t->tag,tag,constructed);
+    tag_len = tlo.len;
+
+    if(t->len != NULL)
+    {
+        if(t->tl_included && !indefinite)     // length includes the tl-part, size of the length may depend on the value
+        {
+            for(i = 0;i < 4;i++)
+            {
+                tlo.len = tag_len;
+                put_length(&tlo,t->len,length,0);
+                length = value_len + tlo.len;
+            }
+            tlo.len = tag_len;
+        }
+        put_length(&tlo,t->len,length,indefinite);
+    }
+
+    out_put(o,tlo.data,tlo.len);
+    free(tlo.data);
+}
+
+/* count tlv definitions having tag. Tags of overlapping definitions are
+   not used because the definition found by tlve depends on the search order */
+static int
+tag_owners(char *tag,TYPE tag_type)
+{
+    struct tlvlist *l;
+    struct tlvdef *p;
+    unsigned long long n;
+    int count = 0;
+
+    n = strtoull(tag,NULL,10);
+
+    for(l = structure.tlv;l != NULL;l = l->next)
+    {
+        p = l->tlv;
+        if(tag_type == T_STRING || tag_type == T_BER)
+        {
+            if(strcmp(tag,p->stag) >= 0 && strcmp(tag,p->etag) <= 0) count++;
+        } else if(isdigit(p->stag[0]) && n >= strtoull(p->stag,NULL,10) && n <= strtoull(p->etag,NULL,10))
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+/* make a tag for tlv definition, random value in tag range */
+static void
+make_tag(struct tlvdef *tlv,struct tldef *t,char *tag)
+{
+    unsigned long long s,e;
+    int tries = 0;
+
+    if(tlv->stag == tlv->etag || strcmp(tlv->stag,tlv->etag) == 0 || !isdigit(tlv->stag[0]))
+    {
+        strcpy(tag,tlv->stag);
+        return;
+    }
+
+    s = strtoull(tlv->stag,NULL,10);
+    e = strtoull(tlv->etag,NULL,10);
+    do
+    {
+        sprintf(tag,"%llu",s + (unsigned long long) rnd((unsigned long) (e - s + 1)));
+    } while(tag_owners(tag,t->tag->type) > 1 && ++tries < 8);
+    if(tries == 8) strcpy(tag,tlv->stag);
+}
+
+/* make a tag not in configuration, return 0 if one was not found */
+static int
+make_unknown_tag(struct tldef *t,char *tag)
+{
+    int tries;
+
+    for(tries = 0;tries < 8;tries++)
+    {
+        switch(t->tag->type)
+        {
+            case T_BER:
+                sprintf(tag,"C-%lu",rnd(30) + 1);
+                break;
+            case T_STRING:
+                sprintf(tag,"X%lu",rnd(1000));
+                break;
+            default:
+                sprintf(tag,"%lu",rnd(t->tag->length > 1 ? 60000 : 250) + 1);
+                break;
+        }
+        if(!tag_owners(tag,t->tag->type)) return 1;
+    }
+    return 0;
+}
+
+/* tag of tlv definition can be used with tag type. Only BER tags tell if the element is
+   constructed, for other tag types constructed elements must have type=constructed */
+static int
+tag_fits(struct tlvdef *tlv,struct tldef *t,int constructed)
+{
+    if(constructed && t->tag->type != T_BER && tlv->type != T_CONSTRUCTED) return 0;
+    if(t->tag->type == T_BER) return strlen(tlv->stag) > 2 && tlv->stag[1] == '-' && strchr("UACP",tlv->stag[0]) != NULL &&
+                                     strcmp(tlv->stag,"U-0") != 0;      // U-0 is end-of-content
+    if(t->tag->type == T_STRING) return 1;
+    return isdigit(tlv->stag[0]);
+}
+
+/* select tlv definition from list matching the tag type */
+static struct tlvdef *
+select_tlv(struct tlvdef **list,int count,struct tldef *t,int constructed)
+{
+    int i,tries;
+
+    if(!count) return NULL;
+
+    for(tries = 0;tries < 8;tries++)
+    {
+        i = (int) rnd((unsigned long) count);
+        if(tag_fits(list[i],t,constructed)) return list[i];
+    }
+    return NULL;
+}
+
+/* octets per character in encoding, characters are written big endian */
+static int
+char_width(char *encoding)
+{
+    if(encoding == NULL) return 1;
+    if(strstr(encoding,"UCS-4") != NULL || strstr(encoding,"UTF-32") != NULL) return 4;
+    if(strstr(encoding,"UCS-2") != NULL || strstr(encoding,"UTF-16") != NULL) return 2;
+    return 1;
+}
+
+/* generate value for tlv definition, tlv is NULL for unknown tags */
+static void
+make_value(struct out *o,struct tlvdef *tlv,struct tldef *t)
+{
+    size_t len,i;
+    int w,width = 1;
+    BUFFER c;
+    TYPE type = T_UNKNOWN;
+    static char printable[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789 .-";
+
+    if(tlv != NULL)
+    {
+        type = tlv->valuetype;
+        width = char_width(tlv->encoding);
+        if(tlv->maybe_constructor) out_put(o,"\0\0\0",3);      // value must not look like a tag-length pair
+    }
+
+    switch(type)
+    {
+        case T_INTBE:
+        case T_INTLE:
+        case T_UINTBE:
+        case T_UINTLE:
+            len = rnd(4) + 1;
+            for(i = 0;i < len;i++) out_putc(o,(BUFFER) rnd(256));
+            break;
+        case T_BCD:
+        case T_BCDS:
+            len = rnd(value_size) + 1;
+            for(i = 0;i < len;i++) out_putc(o,(BUFFER) (rnd(10) << 4 | (i == len - 1 && rnd(2) ? 0xf : rnd(10))));
+            break;
+        case T_HEX:
+        case T_HEXS:
+        case T_OID:
+        case T_BITSTRING:
+        case T_DEC:
+            len = rnd(value_size) + 1;
+            for(i = 0;i < len;i++) out_putc(o,(BUFFER) rnd(256));
+            break;
+        default:
+            len = rnd(value_size) + 1;
+            for(i = 0;i < len;i++)
+            {
+                c = (BUFFER) printable[rnd(sizeof(printable) - 1)];
+                if(t->value_terminator_len && c == t->value_terminator[0]) c = 'x';
+                for(w = 1;w < width;w++) out_putc(o,0);
+                out_putc(o,c);
+            }
+            break;
+    }
+}
+
+/* largest length the length field of t can have */
+static FILE_OFFSET
+max_length(struct tldef *t)
+{
+    FILE_OFFSET max = (FILE_OFFSET) 1 << 62;
+    int i;
+
+    switch(t->len->type)
+    {
+        case T_INTBE:
+        case T_INTLE:
+        case T_UINTBE:
+        case T_UINTLE:
+            if(t->len->length < 7) max = ((FILE_OFFSET) 1 << (8 * t->len->length - (t->len->type == T_INTBE || t->len->type == T_INTLE))) - 1;
+            break;
+        case T_STRING:
+            if(!t->len->use_terminator && t->len->length < 18)
+            {
+                max = 1;
+                for(i = 0;i < (int) t->len->length;i++) max *= 10;
+                max--;
+            }
+            break;
+    }
+    if(t->tl_included) max -= 2 * MAX_TAG_SIZE;
+    return max;
+}
+
+/* generate one element to o using tl t in level */
+static void
+generate(struct out *o,struct tldef *t,int level)
+{
+    struct tlvdef *tlv = NULL;
+    struct tldef *content_tl;
+    struct out content = {NULL,0,0};
+    struct out child = {NULL,0,0};
+    char tag[MAX_TAG_SIZE];
+    int constructed = 0;
+    int indefinite = 0;
+    int i,width;
+
+    elements++;
+
+    if(level < max_depth && rnd(100) < CONSTRUCTED_PCT) tlv = select_tlv(constructors,constructor_count,t,1);
+    if(tlv != NULL)
+    {
+        constructed = 1;
+    } else if(rnd(100) >= (unsigned long) unknown_pct || !make_unknown_tag(t,tag))
+    {
+        tlv = select_tlv(primitives,primitive_count,t,0);
+        if(tlv == NULL && !make_unknown_tag(t,tag)) panic("No suitable tlv definitions for tag-length",t->name,NULL);
+    }
+
+    if(tlv != NULL) make_tag(tlv,t,tag);
+
+    if(constructed)
+    {
+        content_tl = tlv->content_tl != NULL ? tlv->content_tl : t;
+        indefinite = t->tag->type == T_BER && t->len != NULL && t->len->type == T_BER && rnd(100) < (unsigned long) indefinite_pct;
+        if(t->len == NULL) panic("Generator needs length for constructed elements",t->name,NULL);
+        width = (int) rnd((unsigned long) max_width) + 1;
+        for(i = 0;i < width;i++)                  // stop when content does not fit to length field
+        {
+            child.len = 0;
+            generate(&child,content_tl,level + 1);
+            if((FILE_OFFSET) (content.len + child.len) > max_length(t)) break;
+            out_put(&content,child.data,child.len);
+        }
+        free(child.data);
+        if(indefinite) out_put(&content,"\0\0",2);
+        put_tl(o,t,tag,1,content.len,indefinite);
+        out_put(o,content.data,content.len);
+        free(content.data);
+    } else
+    {
+        make_value(&content,tlv,t);
+        if(t->len == NULL)
+        {
+            if(!t->value_terminator_len) panic("Generator needs length or value terminator",t->name,NULL);
+            put_tl(o,t,tag,0,0,0);
+            out_put(o,content.data,content.len);
+            out_put(o,t->value_terminator,t->value_terminator_len);
+        } else
+        {
+            put_tl(o,t,tag,0,content.len,0);
+            out_put(o,content.data,content.len);
+        }
+        free(content.data);
+    }
+}
+
+/* sort tlv definitions of the structure to primitives and constructors */
+static void
+collect_tlvs()
+{
+    struct tlvlist *l;
+    int count = 0;
+
+    for(l = structure.tlv;l != NULL;l = l->next) count++;
+
+    primitives = xmalloc(sizeof(struct tlvdef *) * (count + 1));
+    constructors = xmalloc(sizeof(struct tlvdef *) * (count + 1));
+
+    for(l = structure.tlv;l != NULL;l = l->next)
+    {
+        if(l->tlv->type == T_CONSTRUCTED ||
+           (l->tlv->type == T_UNKNOWN && l->tlv->valuetype == T_UNKNOWN && !l->tlv->maybe_constructor))
+        {
+            constructors[constructor_count++] = l->tlv;
+        }
+        if(l->tlv->type != T_CONSTRUCTED) primitives[primitive_count++] = l->tlv;
+    }
+}
+
+static void
+usage(int status)
+{
+    printf("Usage: %s [OPTION]...\n",program_name);
+    printf("\
+Generate synthetic input data using the tag-length and tlv definitions of a structure.\n\n\
+Options:\n\
+  -c, --configuration NAME    read configuration from NAME\n\
+  -s, --structure NAME        use structure NAME\n\
+  -o, --output NAME           send output to NAME instead of standard output\n\
+  -S, --size SIZE             generate SIZE bytes (K, M and G suffixes allowed, default 1M)\n\
+  -d, --depth LEVELS          maximum depth of constructed elements (default 6)\n\
+  -w, --width COUNT           maximum number of elements in a constructed element (default 8)\n\
+  -i, --indefinite PERCENT    percentage of constructed BER elements with indefinite length (default 0)\n\
+  -u, --unknown PERCENT       percentage of primitive elements not in configuration (default 5)\n\
+  -v, --value-size SIZE       maximum size of a value (default 16)\n\
+  -r, --seed NUMBER           seed for random numbers (default 1)\n\
+  -h, --help                  display this help and exit\n");
+    exit(status);
+}
+
+int
+main(int argc,char **argv)
+{
+    int opt;
+    char *config_to_use = NULL;
+    char *structure_to_use = "default";
+    char *output_to_use = "-";
+    struct out o = {NULL,0,0};
+    FILE *fp;
+    FILE_OFFSET written = 0;
+
+    program_name = "tlve-gen";
+
+#ifdef HAVE_GETOPT_LONG
+    while ((opt = getopt_long(argc,argv,short_opts,long_opts,NULL)) != -1)
+#else
+    while ((opt = getopt(argc,argv,short_opts)) != -1)
+#endif
+    {
+        switch(opt)
+        {
+            case 'c':
+                config_to_use = xstrdup(optarg);
+                break;
+            case 's':
+                structure_to_use = xstrdup(optarg);
+                break;
+            case 'o':
+                output_to_use = xstrdup(optarg);
+                break;
+            case 'S':
+                total_size = parse_size(optarg);
+                break;
+            case 'd':
+                max_depth = atoi(optarg);
+                break;
+            case 'w':
+                max_width = atoi(optarg);
+                if(max_width < 1) max_width = 1;
+                break;
+            case 'i':
+                indefinite_pct = atoi(optarg);
+                break;
+            case 'u':
+                unknown_pct = atoi(optarg);
+                break;
+            case 'v':
+                value_size = (size_t) parse_size(optarg);
+                if(!value_size) value_size = 1;
+                break;
+            case 'r':
+                seed = strtoull(optarg,NULL,10);
+                if(!seed) seed = 1;
+                break;
+            case 'h':
+                usage(EXIT_SUCCESS);
+                break;
+            default:
+                usage(EXIT_FAILURE);
+                break;
+        }
+    }
+
+    if(config_to_use == NULL) panic("Configuration file must be given",NULL,NULL);
+
+    parse_rc(config_to_use,structure_to_use,NULL);
+    collect_tlvs();
+
+    fp = strcmp(output_to_use,"-") == 0 ? stdout : xfopen(output_to_use,"w",'b');
+
+    while(written < total_size)
+    {
+        o.len = 0;
+        generate(&o,structure.content_tl,FIRST_LEVEL);
+        if(fwrite(o.data,(size_t) 1,o.len,fp) != o.len) panic("Error writing to output",strerror(errno),NULL);
+        written += (FILE_OFFSET) o.len;
+    }
+
+    if(fp != stdout) fclose(fp);
+
+    fprintf(stderr,"%s: %lld bytes, %lld elements\n",program_name,(long long) written,(long long) elements);
+    exit(EXIT_SUCCESS);
+}
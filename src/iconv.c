@@ -25,7 +25,7 @@
 
 /* conversion handle */
 #ifdef HAVE_ICONV_T
-static iconv_t *cd = (iconv_t) -1;
+static TLS iconv_t *cd = (iconv_t) -1;
 #endif
 
 /* previous used from/to pair 
@@ -33,12 +33,12 @@ static iconv_t *cd = (iconv_t) -1;
 
    if the same pair id not used, a new handle must be open
  */
-static char *prev_from = "--UNKNOWN--";
-static char *prev_to = "--UNKNOWN--";
+static TLS char *prev_from = "--UNKNOWN--";
+static TLS char *prev_to = "--UNKNOWN--";
 
 /* buffer for conversion */
-static char *outb = NULL;
-static size_t outb_size = 0;
+static TLS char *outb = NULL;
+static TLS size_t outb_size = 0;
 
 /* make conversion return to pointer to converted value */
 char *
@@ -85,6 +85,7 @@ make_iconv(char *data,char *from,char *to)
     }
 
     outb[optr - outb] = 0;
+    stats.iconv_conversions++;
 
     prev_from = from;
     prev_to = to;
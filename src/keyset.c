@@ -0,0 +1,184 @@
+/* 
+   tlve - A program to parse tag-length-value structures and print them in different formats
+
+   Copyright (C) 2009 Timo Savinen
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.  
+*/ 
+#include "tlve.h"
+
+/* Key sets for expressions read from a file, option -E NAME=FILE.
+
+   File contains one value per line. Values are kept in an open addressing
+   hash table, so testing a value costs one lookup regardless of the count of values.
+   Value ending with * is a prefix, for prefixes the set remembers which prefix
+   lengths exist and a value is looked up once for each such length.
+ */
+
+#define MAX_PREFIX_LENGTH 64
+
+struct key_entry
+{
+    size_t hash;             // 0 = empty slot
+    size_t offset;           // offset of the key in text
+    size_t length;
+    int prefix;
+};
+
+struct keyset
+{
+    struct key_entry *table;
+    size_t table_size;
+    size_t count;
+    char *text;              // keys
+    size_t text_len;
+    size_t text_size;
+    unsigned char prefix_lengths[MAX_PREFIX_LENGTH + 1];   // true if there are prefixes of this length
+    int has_prefixes;
+};
+
+/* FNV-1a, 0 is reserved for empty slots */
+static size_t
+key_hash(char *s,size_t len)
+{
+    size_t h = (size_t) 2166136261U;
+
+    while(len--) h = (h ^ (unsigned char) *s++) * (size_t) 16777619U;
+    return h ? h : 1;
+}
+
+static struct key_entry *
+key_find(struct keyset *k,char *s,size_t len,size_t h,int prefix)
+{
+    size_t i = h & (k->table_size - 1);
+    struct key_entry *e;
+
+    while((e = &k->table[i])->hash)
+    {
+        if(e->hash == h && e->length == len && e->prefix == prefix && memcmp(k->text + e->offset,s,len) == 0) return e;
+        i = (i + 1) & (k->table_size - 1);
+    }
+    return e;
+}
+
+static void
+key_grow(struct keyset *k)
+{
+    struct key_entry *old = k->table;
+    size_t old_size = k->table_size,i;
+
+    k->table_size *= 2;
+    k->table = xcalloc(k->table_size,sizeof(struct key_entry));
+
+    for(i = 0;i < old_size;i++)
+    {
+        if(old[i].hash) *key_find(k,k->text + old[i].offset,old[i].length,old[i].hash,old[i].prefix) = old[i];
+    }
+    free(old);
+}
+
+static void
+key_add(struct keyset *k,char *s,size_t len)
+{
+    struct key_entry *e;
+    int prefix = 0;
+    size_t h;
+
+    if(len && s[len - 1] == '*')
+    {
+        len--;
+        if(len > MAX_PREFIX_LENGTH) panic("Too long prefix in key file",NULL,NULL);
+        prefix = 1;
+        k->prefix_lengths[len] = 1;
+        k->has_prefixes = 1;
+    }
+
+    h = key_hash(s,len);
+    e = key_find(k,s,len,h,prefix);
+    if(e->hash) return;             // duplicate
+
+    if(k->text_len + len > k->text_size)
+    {
+        k->text_size = 2 * (k->text_size + len);
+        k->text = xrealloc(k->text,k->text_size);
+    }
+    memcpy(k->text + k->text_len,s,len);
+
+    e->hash = h;
+    e->offset = k->text_len;
+    e->length = len;
+    e->prefix = prefix;
+    k->text_len += len;
+
+    if(2 * ++k->count > k->table_size) key_grow(k);
+}
+
+/* read the keys from file, one value per line */
+struct keyset *
+keyset_load(char *file)
+{
+    struct keyset *k;
+    FILE *fp;
+    char *line = NULL;
+    size_t line_size = 0,len = 0;
+    int c;
+
+    k = xcalloc((size_t) 1,sizeof(struct keyset));
+    k->table_size = 1024;
+    k->table = xcalloc(k->table_size,sizeof(struct key_entry));
+
+    fp = xfopen(file,"r",'a');
+    do
+    {
+        c = getc(fp);
+        if(c == '\n' || c == EOF)
+        {
+            if(len && line[len - 1] == '\r') len--;
+            if(len) key_add(k,line,len);
+            len = 0;
+        } else
+        {
+            if(len == line_size)
+            {
+                line_size = line_size ? 2 * line_size : 256;
+                line = xrealloc(line,line_size);
+            }
+            line[len++] = (char) c;
+        }
+    } while(c != EOF);
+
+    if(ferror(fp)) panic("Error in reading file",file,strerror(errno));
+    fclose(fp);
+    free(line);
+    return k;
+}
+
+/* return true if value is in set or starts with a prefix in set */
+int
+keyset_match(struct keyset *k,char *value)
+{
+    size_t len = strlen(value),l;
+
+    if(key_find(k,value,len,key_hash(value,len),0)->hash) return 1;
+
+    if(k->has_prefixes)
+    {
+        for(l = 0;l <= len && l <= MAX_PREFIX_LENGTH;l++)
+        {
+            if(k->prefix_lengths[l] && key_find(k,value,l,key_hash(value,l),1)->hash) return 1;
+        }
+    }
+    return 0;
+}
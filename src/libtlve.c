@@ -0,0 +1,569 @@
+/* 
+   tlve - A program to parse tag-length-value structures and print them in different formats
+
+   Copyright (C) 2009 Timo Savinen
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.  
+*/ 
+#include "tlve.h"
+#include "libtlve.h"
+
+#ifndef EXIT_FAILURE
+#define EXIT_FAILURE 1
+#endif
+
+#ifdef PACKAGE
+char *program_name = PACKAGE;
+#else
+char *program_name = "tlve";
+#endif
+
+/* Global data, each thread has its own copy */
+
+TLS struct structure structure;
+TLS struct tldef *tl = NULL;
+TLS struct print *print = NULL;
+TLS struct hold *hold = NULL;
+TLS struct type_mappings *type_maps = NULL;
+TLS char *codeset = "";           // current code set
+TLS int debug = 0;                // write debug data in case of processing error
+TLS char *tlve_open = NULL;
+
+struct tlve_parser
+{
+    int loaded;                      // configuration is read
+    struct tlve_callbacks callbacks; // user callbacks
+    void *user;                      // user data given to callbacks
+    char error[1024];                // message of the last error
+    int cursor;                      // cursor is open
+    struct tlvitem *item;            // element returned last by tlve_next
+    int converted;                   // value of item has been converted
+};
+
+/* parser bound to this thread, NULL if none */
+static TLS struct tlve_parser *current_parser = NULL;
+
+/* when an API call is active, panic jumps here instead of exiting */
+static TLS jmp_buf *panic_env = NULL;
+
+/* when set, errors in input data jump here instead of exiting, see data_error_catch */
+static TLS jmp_buf *data_error_env = NULL;
+
+/* message of the last caught panic or data error */
+static TLS char caught_message[1024];
+
+/* make error message from message parts */
+static void
+make_message(char *message,size_t size,char *msg,char *info,char *syserror)
+{
+    message[0] = 0;
+    if(msg != NULL)
+    {
+        if (info == NULL && syserror == NULL)
+        {
+            snprintf(message,size,"%s",msg);
+        } else if(info != NULL && syserror == NULL)
+        {
+            snprintf(message,size,"%s: %s",msg,info);
+        } else if(info != NULL && syserror != NULL)
+        {
+            snprintf(message,size,"%s: %s; %s",msg,info,syserror);
+        } else if(info == NULL && syserror != NULL)
+        {
+            snprintf(message,size,"%s; %s",msg,syserror);
+        }
+    }
+}
+
+/* Print the error message and exit, or if called from the library
+   save the message and return to the active API call
+ */
+void
+panic(char *msg,char *info,char *syserror)
+{
+    char message[1024];
+
+    make_message(message,sizeof(message),msg,info,syserror);
+
+    if(panic_env != NULL)
+    {
+        strcpy(caught_message,message[0] ? message : "Processing error");
+        if(current_parser != NULL) strcpy(current_parser->error,caught_message);
+        longjmp(*panic_env,1);
+    }
+
+    if(message[0]) fprintf(stderr,"%s: %s\n",program_name,message);
+    exit(EXIT_FAILURE);
+}
+
+/* Error in input data or an input file which cannot be opened. If data errors
+   are caught, save the message and jump to the catcher, otherwise same as panic.
+   Other errors, like write errors of output, are always handled by panic
+ */
+void
+data_error(char *msg,char *info,char *syserror)
+{
+    if(data_error_env != NULL)
+    {
+        make_message(caught_message,sizeof(caught_message),msg,info,syserror);
+        if(!caught_message[0]) strcpy(caught_message,"Processing error");
+        longjmp(*data_error_env,1);
+    }
+    panic(msg,info,syserror);
+}
+
+/* return true if data_error returns to a catcher or to the library caller instead of exiting */
+int
+data_error_is_caught()
+{
+    return data_error_env != NULL || panic_env != NULL;
+}
+
+/* jump to env on data errors instead of exiting, NULL restores exiting.
+   Program uses this to continue with the next file when validating and to resynchronize
+ */
+void
+data_error_catch(jmp_buf *env)
+{
+    data_error_env = env;
+}
+
+/* return the message of the last caught panic or data error */
+char *
+panic_message()
+{
+    return caught_message;
+}
+
+/* create a new parser, only one parser can exist in one thread.
+   Return NULL if this thread has a parser already
+ */
+tlve_parser *
+tlve_new(void)
+{
+    if(current_parser != NULL) return NULL;
+
+    current_parser = xmalloc(sizeof(struct tlve_parser));
+    memset(current_parser,0,sizeof(struct tlve_parser));
+    return current_parser;
+}
+
+/* read the structure from configuration file rc_file, if structure is NULL
+   structure "default" is used. Previously read configuration is released
+ */
+int
+tlve_load(tlve_parser *p,const char *rc_file,const char *structure_name)
+{
+    jmp_buf env;
+
+    if(p != current_parser) return TLVE_ERROR;
+
+    p->error[0] = 0;
+    panic_env = &env;
+    if(setjmp(env))
+    {
+        panic_env = NULL;
+        p->loaded = 0;
+        return TLVE_ERROR;
+    }
+
+    free_rc();
+    parse_rc((char *) rc_file,structure_name != NULL ? (char *) structure_name : "default",NULL);
+    execute_init();
+    set_read_ahead(0);              // callbacks are run in the caller's thread, no need for I/O thread
+    set_batch_files(0);
+
+    panic_env = NULL;
+    p->loaded = 1;
+    return TLVE_OK;
+}
+
+void
+tlve_set_callbacks(tlve_parser *p,const struct tlve_callbacks *callbacks,void *user)
+{
+    if(p != current_parser) return;
+
+    if(callbacks != NULL)
+    {
+        p->callbacks = *callbacks;
+    } else
+    {
+        memset(&p->callbacks,0,sizeof(p->callbacks));
+    }
+    p->user = user;
+}
+
+/* make public element from tlvitem */
+static void
+make_element(struct tlvitem *i,struct tlve_element *e,int converted)
+{
+    e->level = (int) i->level;
+    e->name = i->tlv != NULL ? i->tlv->name : NULL;
+    e->tag = i->tag;
+    e->type = i->type;
+    e->length = (unsigned long long) i->length;
+    e->file_offset = (unsigned long long) i->file_offset;
+    e->total_offset = (unsigned long long) i->total_offset;
+    e->raw_tl = i->raw_tl;
+    e->raw_tl_length = i->raw_tl_length;
+    e->int_value = 0;
+    e->uint_value = 0;
+
+    if(i->tlv_type == T_CONSTRUCTED)
+    {
+        e->raw_value = NULL;
+        e->raw_value_length = 0;
+        e->value = NULL;
+        e->value_type = TLVE_VALUE_NONE;
+        return;
+    }
+
+    e->raw_value = i->raw_value;
+    e->raw_value_length = i->raw_value_length;
+    e->value = converted ? i->converted_value : NULL;
+
+    switch(i->valuetype)
+    {
+        case T_INTBE:
+        case T_INTLE:
+            e->value_type = TLVE_VALUE_INT;
+            if(converted) e->int_value = i->int_value;
+            break;
+        case T_UINTBE:
+        case T_UINTLE:
+            e->value_type = TLVE_VALUE_UINT;
+            if(converted) e->uint_value = (unsigned long long) i->int_value;
+            break;
+        case T_STRING:
+            e->value_type = TLVE_VALUE_STRING;
+            break;
+        default:
+            e->value_type = TLVE_VALUE_TEXT;
+            break;
+    }
+}
+
+static int
+handle_element(struct tlvitem *i,void *data)
+{
+    struct tlve_parser *p = (struct tlve_parser *) data;
+    struct tlve_element e;
+
+    if(p->callbacks.element == NULL) return 0;
+    make_element(i,&e,1);
+    return p->callbacks.element(p->user,&e);
+}
+
+static int
+handle_level_enter(struct tlvitem *i,void *data)
+{
+    struct tlve_parser *p = (struct tlve_parser *) data;
+    struct tlve_element e;
+
+    if(p->callbacks.level_enter == NULL) return 0;
+    make_element(i,&e,1);
+    return p->callbacks.level_enter(p->user,&e);
+}
+
+static int
+handle_level_exit(int level,void *data)
+{
+    struct tlve_parser *p = (struct tlve_parser *) data;
+
+    if(p->callbacks.level_exit == NULL) return 0;
+    return p->callbacks.level_exit(p->user,level);
+}
+
+/* parse the input given by set_input_* */
+static int
+parse_input(tlve_parser *p)
+{
+    jmp_buf env;
+    struct handler h;
+    int stop;
+
+    h.element = handle_element;
+    h.level_enter = handle_level_enter;
+    h.level_exit = handle_level_exit;
+    h.data = p;
+    p->cursor = 0;
+    p->item = NULL;
+
+    panic_env = &env;
+    if(setjmp(env))
+    {
+        panic_env = NULL;
+        clear_input_files();
+        return TLVE_ERROR;
+    }
+
+    stop = execute_handler(&h);
+
+    panic_env = NULL;
+    clear_input_files();
+    return stop ? TLVE_STOPPED : TLVE_OK;
+}
+
+/* parse data in memory, data is parsed in place and it is not copied */
+int
+tlve_parse_memory(tlve_parser *p,const void *data,size_t len)
+{
+    if(p != current_parser || !p->loaded) return TLVE_ERROR;
+
+    p->error[0] = 0;
+    clear_input_files();
+    set_input_memory((BUFFER *) data,len);
+    return parse_input(p);
+}
+
+/* parse data read from file descriptor fd, fd is not closed */
+int
+tlve_parse_fd(tlve_parser *p,int fd)
+{
+    int nfd;
+    FILE *fp;
+
+    if(p != current_parser || !p->loaded) return TLVE_ERROR;
+
+    p->error[0] = 0;
+    nfd = dup(fd);
+    if(nfd == -1 || (fp = fdopen(nfd,"r")) == NULL)
+    {
+        snprintf(p->error,sizeof(p->error),"Cannot read file descriptor; %s",strerror(errno));
+        if(nfd != -1) close(nfd);
+        return TLVE_ERROR;
+    }
+
+    clear_input_files();
+    set_input_stream(fp,"fd");
+    return parse_input(p);
+}
+
+/* cursor failed, close it */
+static int
+cursor_failed(tlve_parser *p)
+{
+    panic_env = NULL;
+    p->cursor = 0;
+    p->item = NULL;
+    clear_input_files();
+    return TLVE_ERROR;
+}
+
+/* open cursor for the input given by set_input_* */
+static int
+cursor_open(tlve_parser *p)
+{
+    jmp_buf env;
+
+    p->item = NULL;
+    panic_env = &env;
+    if(setjmp(env)) return cursor_failed(p);
+
+    cursor_start();
+
+    panic_env = NULL;
+    p->cursor = 1;
+    return TLVE_OK;
+}
+
+/* open cursor for data in memory, data is not copied */
+int
+tlve_cursor_memory(tlve_parser *p,const void *data,size_t len)
+{
+    if(p != current_parser || !p->loaded) return TLVE_ERROR;
+
+    p->error[0] = 0;
+    clear_input_files();
+    set_input_memory((BUFFER *) data,len);
+    return cursor_open(p);
+}
+
+/* open cursor for data read from file descriptor fd, fd is not closed */
+int
+tlve_cursor_fd(tlve_parser *p,int fd)
+{
+    int nfd;
+    FILE *fp;
+
+    if(p != current_parser || !p->loaded) return TLVE_ERROR;
+
+    p->error[0] = 0;
+    nfd = dup(fd);
+    if(nfd == -1 || (fp = fdopen(nfd,"r")) == NULL)
+    {
+        snprintf(p->error,sizeof(p->error),"Cannot read file descriptor; %s",strerror(errno));
+        if(nfd != -1) close(nfd);
+        return TLVE_ERROR;
+    }
+
+    clear_input_files();
+    set_input_stream(fp,"fd");
+    return cursor_open(p);
+}
+
+/* return the next element of current level in e, return 1 if found,
+   0 if the level or input has ended
+ */
+int
+tlve_next(tlve_parser *p,struct tlve_element *e)
+{
+    jmp_buf env;
+
+    if(p != current_parser || !p->cursor) return TLVE_ERROR;
+
+    panic_env = &env;
+    if(setjmp(env)) return cursor_failed(p);
+
+    p->item = cursor_next();
+    p->converted = 0;
+
+    panic_env = NULL;
+    if(p->item == NULL) return 0;
+    make_element(p->item,e,0);
+    return 1;
+}
+
+/* go into the constructed element returned last by tlve_next */
+int
+tlve_enter(tlve_parser *p)
+{
+    jmp_buf env;
+    int ok;
+
+    if(p != current_parser || !p->cursor) return TLVE_ERROR;
+
+    panic_env = &env;
+    if(setjmp(env)) return cursor_failed(p);
+
+    ok = cursor_enter();
+    p->item = NULL;
+
+    panic_env = NULL;
+    if(!ok)
+    {
+        strcpy(p->error,"Element is not constructed");
+        return TLVE_ERROR;
+    }
+    return TLVE_OK;
+}
+
+/* skip the rest of the constructed element entered last, parsing continues
+   in its parent level
+ */
+int
+tlve_skip(tlve_parser *p)
+{
+    jmp_buf env;
+    int ok;
+
+    if(p != current_parser || !p->cursor) return TLVE_ERROR;
+
+    panic_env = &env;
+    if(setjmp(env)) return cursor_failed(p);
+
+    ok = cursor_leave();
+    p->item = NULL;
+
+    panic_env = NULL;
+    if(!ok)
+    {
+        strcpy(p->error,"Not inside a constructed element");
+        return TLVE_ERROR;
+    }
+    return TLVE_OK;
+}
+
+/* return the integer value of the element returned last */
+int
+tlve_value_int(tlve_parser *p,long long *value)
+{
+    if(p != current_parser || p->item == NULL || p->item->tlv_type == T_CONSTRUCTED || !item_int_value(p->item,value))
+    {
+        strcpy(p->error,"Element does not have integer value");
+        return TLVE_ERROR;
+    }
+    return TLVE_OK;
+}
+
+/* return pointer to the raw value of the element returned last, and the length in *length */
+const unsigned char *
+tlve_value_bytes(tlve_parser *p,size_t *length)
+{
+    if(p != current_parser || p->item == NULL || p->item->tlv_type == T_CONSTRUCTED)
+    {
+        *length = 0;
+        return NULL;
+    }
+    *length = p->item->value_length;
+    return p->item->raw_value;
+}
+
+/* return the value of the element returned last converted to visible string */
+const char *
+tlve_value_text(tlve_parser *p)
+{
+    jmp_buf env;
+
+    if(p != current_parser || p->item == NULL || p->item->tlv_type == T_CONSTRUCTED) return NULL;
+    if(p->converted) return p->item->converted_value;
+
+    panic_env = &env;
+    if(setjmp(env))
+    {
+        cursor_failed(p);
+        return NULL;
+    }
+
+    convert_value(p->item);
+    p->converted = 1;
+
+    panic_env = NULL;
+    return p->item->converted_value;
+}
+
+/* close the cursor */
+void
+tlve_cursor_close(tlve_parser *p)
+{
+    if(p != current_parser || !p->cursor) return;
+
+    clear_input_files();
+    p->cursor = 0;
+    p->item = NULL;
+}
+
+/* return the message of the last error, empty string if no error */
+const char *
+tlve_error(tlve_parser *p)
+{
+    return p->error;
+}
+
+/* release the parser and the configuration read by tlve_load,
+   after this a new parser can be created in this thread
+ */
+void
+tlve_free(tlve_parser *p)
+{
+    if(p == NULL || p != current_parser) return;
+
+    clear_input_files();
+    buffer_free();
+    free_rc();
+    execute_free();
+    current_parser = NULL;
+    free(p);
+}
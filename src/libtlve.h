@@ -0,0 +1,120 @@
+/* 
+   tlve - A program to parse tag-length-value structures and print them in different formats
+
+   Copyright (C) 2009 Timo Savinen
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.  
+*/ 
+
+/* Public interface of libtlve, the tlve parser as a library.
+
+   Parsing is driven by callbacks: element is called for every primitive
+   element, level_enter for every constructed element and level_exit when
+   a constructed element ends. Returning non-zero from a callback stops the parsing.
+
+   Alternatively elements can be read one by one using a cursor: tlve_next returns
+   the next element of the current level, tlve_enter goes into a constructed element
+   and tlve_skip leaves it. Constructed elements which are not entered are skipped
+   without parsing their content. Values are converted only when asked with tlve_value_*.
+
+   Parser state is kept per thread, the parser is not a reentrant context: one parser
+   can exist in each thread at a time, tlve_new returns NULL if the thread has a parser
+   already. The parser must be used and freed only in the thread which created it,
+   calls with a parser of another thread fail. tlve_free releases the parser and its
+   configuration, after that a new parser can be created in the thread.
+ */
+
+#ifndef LIBTLVE_H
+#define LIBTLVE_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* only the functions of this interface are exported from the library */
+#if defined(__GNUC__) && __GNUC__ >= 4
+#define TLVE_API __attribute__((visibility("default")))
+#else
+#define TLVE_API
+#endif
+
+typedef struct tlve_parser tlve_parser;
+
+/* return codes */
+#define TLVE_OK 0                // all input was parsed
+#define TLVE_STOPPED 1           // a callback stopped the parsing
+#define TLVE_ERROR -1            // error, message is available using tlve_error
+
+/* value types of struct tlve_element */
+#define TLVE_VALUE_NONE 0        // constructed element, no value
+#define TLVE_VALUE_INT 1         // signed integer, see int_value
+#define TLVE_VALUE_UINT 2        // unsigned integer, see uint_value
+#define TLVE_VALUE_STRING 3      // string, value contains the raw bytes null-terminated
+#define TLVE_VALUE_TEXT 4        // other types converted to visible text (hex, bcd, oid...)
+
+struct tlve_element
+{
+    int level;                       // level of the element, first level is 1
+    const char *name;                // name from the configuration, NULL if element is not known
+    const char *tag;                 // tag as visible string
+    const char *type;                // type as visible string, empty if structure has no types
+    unsigned long long length;       // length from the tag-length pair
+    unsigned long long file_offset;  // offset of the element in current input
+    unsigned long long total_offset; // offset of the element in all input
+    const unsigned char *raw_tl;     // raw tag-length pair
+    size_t raw_tl_length;
+    const unsigned char *raw_value;  // raw value of a primitive element
+    size_t raw_value_length;
+    const char *value;               // converted value, NULL for constructed elements and from tlve_next
+    int value_type;                  // one of TLVE_VALUE_*
+    long long int_value;             // value for TLVE_VALUE_INT, not set by tlve_next
+    unsigned long long uint_value;   // value for TLVE_VALUE_UINT, not set by tlve_next
+};
+
+/* Pointers in the element are valid only during the callback call */
+struct tlve_callbacks
+{
+    int (*element)(void *user,const struct tlve_element *e);
+    int (*level_enter)(void *user,const struct tlve_element *e);
+    int (*level_exit)(void *user,int level);
+};
+
+TLVE_API tlve_parser *tlve_new(void);
+TLVE_API int tlve_load(tlve_parser *p,const char *rc_file,const char *structure);
+TLVE_API void tlve_set_callbacks(tlve_parser *p,const struct tlve_callbacks *callbacks,void *user);
+TLVE_API int tlve_parse_memory(tlve_parser *p,const void *data,size_t len);
+TLVE_API int tlve_parse_fd(tlve_parser *p,int fd);
+
+TLVE_API int tlve_cursor_memory(tlve_parser *p,const void *data,size_t len);
+TLVE_API int tlve_cursor_fd(tlve_parser *p,int fd);
+TLVE_API int tlve_next(tlve_parser *p,struct tlve_element *e);
+TLVE_API int tlve_enter(tlve_parser *p);
+TLVE_API int tlve_skip(tlve_parser *p);
+TLVE_API int tlve_value_int(tlve_parser *p,long long *value);
+TLVE_API const unsigned char *tlve_value_bytes(tlve_parser *p,size_t *length);
+TLVE_API const char *tlve_value_text(tlve_parser *p);
+TLVE_API void tlve_cursor_close(tlve_parser *p);
+
+TLVE_API const char *tlve_error(tlve_parser *p);
+TLVE_API void tlve_free(tlve_parser *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
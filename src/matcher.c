@@ -0,0 +1,261 @@
+/* 
+   tlve - A program to parse tag-length-value structures and print them in different formats
+
+   Copyright (C) 2009 Timo Savinen
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.  
+*/ 
+#include "tlve.h"
+
+/* Multi-pattern matcher for expressions.
+
+   Regular expressions which are plain strings, optionally anchored by ^ and/or $,
+   are collected to an Aho-Corasick automaton, one for each element name. A value is
+   scanned once regardless of the count of patterns. Anchors are checked when a
+   pattern is found.
+
+   Characters used in patterns are mapped to classes, other characters go to
+   class 0 which never continues a pattern. Transition table has a row of classes
+   for each state.
+ */
+
+struct pattern
+{
+    char *text;              // pattern without anchors
+    size_t length;
+    int start;               // anchored to start of value
+    int end;                 // anchored to end of value
+    int *result;             // set to 1 when the pattern matches
+    int next;                // next pattern ending in the same state, -1 = none
+};
+
+struct matcher
+{
+    struct pattern *patterns;
+    int pattern_count;
+    int pattern_size;
+    unsigned char classes[256];
+    int class_count;
+    int *delta;              // state * class_count + class
+    int *fail;
+    int *output;             // first pattern ending in state, -1 = none
+    int *dict;               // nearest state via fail links having output, 0 = none
+    int state_count;
+    int state_size;
+};
+
+struct matcher *
+matcher_new()
+{
+    struct matcher *m = xcalloc((size_t) 1,sizeof(struct matcher));
+
+    m->class_count = 1;
+    return m;
+}
+
+/* check that regular expression re is a plain string. Return the
+   string without anchors, NULL if re has other special characters
+ */
+static char *
+literal(char *re,int *start,int *end)
+{
+    char *s = xmalloc(strlen(re) + 1);
+    size_t len = 0;
+
+    *start = *end = 0;
+    if(*re == '^')
+    {
+        *start = 1;
+        re++;
+    }
+
+    while(*re)
+    {
+        if(*re == '$' && !re[1])
+        {
+            *end = 1;
+            break;
+        }
+        if(*re == '\\' && re[1] && !isalnum((unsigned char) re[1]))
+        {
+            re++;
+        } else if(strchr(".[]()*+?{}|\\^$",*re) != NULL)
+        {
+            free(s);
+            return NULL;
+        }
+        s[len++] = *re++;
+    }
+    s[len] = 0;
+
+    if(!len)
+    {
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+/* add regular expression re to matcher, result is set to 1 when re matches.
+   Return 0 if re is not a plain string and cannot be added
+ */
+int
+matcher_add(struct matcher *m,char *re,int *result)
+{
+    struct pattern *p;
+    char *s;
+    int start,end;
+
+    if((s = literal(re,&start,&end)) == NULL) return 0;
+
+    if(m->pattern_count == m->pattern_size)
+    {
+        m->pattern_size = m->pattern_size ? 2 * m->pattern_size : 16;
+        m->patterns = xrealloc(m->patterns,sizeof(struct pattern) * m->pattern_size);
+    }
+    p = &m->patterns[m->pattern_count++];
+    p->text = s;
+    p->length = strlen(s);
+    p->start = start;
+    p->end = end;
+    p->result = result;
+    p->next = -1;
+
+    for(;*s;s++)
+    {
+        if(!m->classes[(unsigned char) *s])
+        {
+            if(m->class_count == 256) panic("Too many different characters in expressions",re,NULL);
+            m->classes[(unsigned char) *s] = (unsigned char) m->class_count++;
+        }
+    }
+    return 1;
+}
+
+static int
+new_state(struct matcher *m)
+{
+    int c;
+
+    if(m->state_count == m->state_size)
+    {
+        m->state_size = m->state_size ? 2 * m->state_size : 64;
+        m->delta = xrealloc(m->delta,sizeof(int) * m->state_size * m->class_count);
+        m->output = xrealloc(m->output,sizeof(int) * m->state_size);
+    }
+    for(c = 0;c < m->class_count;c++) m->delta[m->state_count * m->class_count + c] = -1;
+    m->output[m->state_count] = -1;
+    return m->state_count++;
+}
+
+/* build the automaton, called after all patterns have been added */
+void
+matcher_compile(struct matcher *m)
+{
+    int i,s,t,c,head = 0,tail = 0,*queue;
+    char *p;
+
+    new_state(m);             // root
+
+    /* trie */
+    for(i = 0;i < m->pattern_count;i++)
+    {
+        s = 0;
+        for(p = m->patterns[i].text;*p;p++)
+        {
+            c = m->classes[(unsigned char) *p];
+            if(m->delta[s * m->class_count + c] < 0)
+            {
+                t = new_state(m);
+                m->delta[s * m->class_count + c] = t;
+            }
+            s = m->delta[s * m->class_count + c];
+        }
+        m->patterns[i].next = m->output[s];
+        m->output[s] = i;
+    }
+
+    m->fail = xmalloc(sizeof(int) * m->state_count);
+    m->dict = xmalloc(sizeof(int) * m->state_count);
+    queue = xmalloc(sizeof(int) * m->state_count);
+
+    /* breadth first, missing transitions are replaced by the transitions of fail state */
+    m->fail[0] = 0;
+    m->dict[0] = 0;
+    for(c = 0;c < m->class_count;c++)
+    {
+        t = m->delta[c];
+        if(t < 0 || c == 0)
+        {
+            m->delta[c] = 0;
+        } else
+        {
+            m->fail[t] = 0;
+            m->dict[t] = 0;
+            queue[tail++] = t;
+        }
+    }
+
+    while(head < tail)
+    {
+        s = queue[head++];
+        for(c = 0;c < m->class_count;c++)
+        {
+            t = m->delta[s * m->class_count + c];
+            if(t < 0 || c == 0)
+            {
+                m->delta[s * m->class_count + c] = c ? m->delta[m->fail[s] * m->class_count + c] : 0;
+            } else
+            {
+                m->fail[t] = m->delta[m->fail[s] * m->class_count + c];
+                m->dict[t] = m->output[m->fail[t]] >= 0 ? m->fail[t] : m->dict[m->fail[t]];
+                queue[tail++] = t;
+            }
+        }
+    }
+
+    free(queue);
+}
+
+static inline void
+match_state(struct matcher *m,int s,size_t pos,size_t len)
+{
+    struct pattern *p;
+    int i;
+
+    for(i = m->output[s];i >= 0;i = p->next)
+    {
+        p = &m->patterns[i];
+        if(p->start && pos + 1 != p->length) continue;
+        if(p->end && pos + 1 != len) continue;
+        *p->result = 1;
+    }
+}
+
+/* scan value and set results of the matching patterns */
+void
+matcher_scan(struct matcher *m,char *value)
+{
+    size_t pos,len = strlen(value);
+    int s = 0,d;
+
+    for(pos = 0;pos < len;pos++)
+    {
+        s = m->delta[s * m->class_count + m->classes[(unsigned char) value[pos]]];
+        if(m->output[s] >= 0) match_state(m,s,pos,len);
+        for(d = m->dict[s];d;d = m->dict[d]) match_state(m,d,pos,len);
+    }
+}
+
@@ -80,13 +80,13 @@
 /* error value for unknown data */
 #define E_UNKNOWN 99999
 /* Keywords */
-static char *keywords[K_MAX + 1];
+static TLS char *keywords[K_MAX + 1];
 
 /* Parameters */
-static char *parameters[P_MAX + 1];
+static TLS char *parameters[P_MAX + 1];
 
 /* Types */
-static char *types[T_MAX + 1];
+static TLS char *types[T_MAX + 1];
 
 /* One paramter/value pair found in config line */
 struct rcconfig
@@ -97,25 +97,32 @@ struct rcconfig
 };
 
 /* Paramter/value pairs for current line */
-static struct rcconfig pvpairs[MAX_PARAMETER];
-static int parameter_count;
+static TLS struct rcconfig pvpairs[MAX_PARAMETER];
+static TLS int parameter_count;
 
 /* Current lineno */
-static int lineno = 0;
+static TLS int lineno = 0;
 
 /* Found keyword in current line */
-static int keyword;
+static TLS int keyword;
 
 /* Current line, starting whitespaces and comments trimmed */
-static unsigned char *line = NULL;
-static size_t line_length;
+static TLS unsigned char *line = NULL;
+static TLS size_t line_length;
 
 /* rcfile handle */
-static FILE *rcfp;
+static TLS FILE *rcfp = NULL;
 
 /* ber content terminator string for indefinite elements */
 static BUFFER ber_content_terminator[] = {'\000','\000'};
 
+/* defaults which are not allocated, see free_rc */
+static char default_print_name[] = "default";
+static char default_content[] = "%v";
+
+/* printing definition given to parse_rc, not allocated */
+static TLS char *rc_printing = NULL;
+
 static void
 verify_rc_data();
 
@@ -676,6 +683,7 @@ parse_rc(char *rcfile, char *required_structure,char *printing)
     struct tlvlist *ctlvl = NULL;
     struct print *cprint = NULL;
 
+    rc_printing = printing;
     rcfp = xfopen(rcfile,"r",'a');
 
     line_length = 1024;
@@ -693,7 +701,7 @@ parse_rc(char *rcfile, char *required_structure,char *printing)
                 if(state != READING) config_panic("Structure keyword found",NULL,NULL);
                 if(check_structure_name(required_structure) && structure.name == NULL)
                 {
-                    structure.print_name = printing != NULL ? printing : "default";
+                    structure.print_name = printing != NULL ? printing : default_print_name;
                     structure.content_tl = NULL;
                     structure.tlv = NULL;
                     structure.filler_string = NULL;
@@ -1085,7 +1093,7 @@ parse_rc(char *rcfile, char *required_structure,char *printing)
                     }
                     if(ctlv->hold_buffer != NULL && ctlv->name != NULL && ctlv->hold_buffer->name == NULL) 
                     {
-                        ctlv->hold_buffer->name = ctlv->name;
+                        ctlv->hold_buffer->name = xstrdup(ctlv->name);
                         ctlv->hold_buffer->name_len = strlen(ctlv->name);
                     }
                     if(ctlv->stag == NULL) config_panic("tlv: tag missing",NULL,NULL);
@@ -1113,7 +1121,7 @@ parse_rc(char *rcfile, char *required_structure,char *printing)
                     cprint->block_end = NULL;
                     cprint->level_head = NULL;
                     cprint->level_trailer = NULL;
-                    cprint->content = "%v";
+                    cprint->content = default_content;
                     cprint->ucontent = NULL;
                     cprint->indent = NULL;
                     cprint->encoding = NULL;
@@ -1178,7 +1186,9 @@ parse_rc(char *rcfile, char *required_structure,char *printing)
         }
     }
     fclose(rcfp);
+    rcfp = NULL;
     free(line);
+    line = NULL;
     if(state == STRUCTURE_READING) config_panic("Structure definition has no end keyword",NULL,NULL);
     if(state == TYPEMAP_READING) config_panic("Typemap definition has no end keyword",NULL,NULL);
     if(structure.name == NULL) panic("No structure named as",required_structure,NULL);
@@ -1235,6 +1245,8 @@ verify_rc_data()
     struct tlvdef *tlv;
     struct tlvlist *tlvl;
     struct tldef *t;
+    struct print *p;
+    int index = 0;
 
     structure.p = search_print(structure.print_name);
     if(structure.p == NULL) panic("No printing definition named as",structure.print_name,NULL);
@@ -1247,6 +1259,7 @@ verify_rc_data()
     while(tlvl != NULL)
     {
         tlv = tlvl->tlv;
+        tlv->index = index++;
         if(tlv->content_tl_name != NULL)
         {
             tlv->content_tl = search_tl(tlv->content_tl_name);
@@ -1261,6 +1274,9 @@ verify_rc_data()
         tlvl = tlvl->next;
     }
 
+    index = 0;
+    for(p = print;p != NULL;p = p->next) p->index = index++;
+
     t = tl;
 
     while(t != NULL)
@@ -1276,3 +1292,106 @@ verify_rc_data()
         t = t->next;
     }
 }
+
+/* free name given to a definition, names given to parse_rc and structure are shared */
+static void
+free_print_name(char *name)
+{
+    if(name != rc_printing && name != structure.print_name) free(name);
+}
+
+/* release the definitions read by parse_rc, also partially read ones after an error.
+   Globals are left empty so that parse_rc can be called again
+ */
+void
+free_rc()
+{
+    struct tldef *t,*tnext;
+    struct type_mappings *ms,*msnext;
+    struct type_map *m,*mnext;
+    struct tlvlist *tlvl,*tlvlnext;
+    struct hold *h,*hnext;
+    struct print *p,*pnext;
+
+    if(rcfp != NULL) fclose(rcfp);
+    rcfp = NULL;
+    free(line);
+    line = NULL;
+
+    for(t = tl;t != NULL;t = tnext)
+    {
+        tnext = t->next;
+        free(t->name);
+        free(t->tag);
+        free(t->type);
+        free(t->len);
+        if(t->value_terminator != ber_content_terminator) free(t->value_terminator);
+        free_print_name(t->print_name);
+        free(t->type_mapping);
+        free(t);
+    }
+    tl = NULL;
+
+    for(ms = type_maps;ms != NULL;ms = msnext)
+    {
+        msnext = ms->next;
+        for(m = ms->mappings;m != NULL;m = mnext)
+        {
+            mnext = m->next;
+            free(m->source_type);
+            free(m);
+        }
+        free(ms->name);
+        free(ms);
+    }
+    type_maps = NULL;
+
+    for(tlvl = structure.tlv;tlvl != NULL;tlvl = tlvlnext)
+    {
+        tlvlnext = tlvl->next;
+        free(tlvl->tlv->path);
+        free(tlvl->tlv->name);
+        if(tlvl->tlv->etag != tlvl->tlv->stag) free(tlvl->tlv->etag);
+        free(tlvl->tlv->stag);
+        free(tlvl->tlv->content_tl_name);
+        free_print_name(tlvl->tlv->print_name);
+        free(tlvl->tlv->encoding);
+        free(tlvl->tlv->format);
+        free(tlvl->tlv);
+        free(tlvl);
+    }
+
+    for(h = hold;h != NULL;h = hnext)
+    {
+        hnext = h->next;
+        free(h->name);
+        free(h->buffer);
+        free(h);
+    }
+    hold = NULL;
+
+    for(p = print;p != NULL;p = pnext)
+    {
+        pnext = p->next;
+        free(p->name);
+        free(p->file_head);
+        free(p->file_trailer);
+        free(p->level_head);
+        free(p->level_trailer);
+        free(p->block_start);
+        free(p->block_end);
+        if(p->ucontent != p->content) free(p->ucontent);
+        if(p->content != default_content) free(p->content);
+        free(p->indent);
+        free(p->encoding);
+        free(p);
+    }
+    print = NULL;
+
+    free(structure.name);
+    if(structure.print_name != rc_printing && structure.print_name != default_print_name) free(structure.print_name);
+    free(structure.tl_name);
+    free(structure.filler_string);
+    memset(&structure,0,sizeof(structure));
+    rc_printing = NULL;
+}
@@ -0,0 +1,168 @@
+/* 
+   tlve - A program to parse tag-length-value structures and print them in different formats
+
+   Copyright (C) 2009 Timo Savinen
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.  
+*/ 
+#include "tlve.h"
+
+/* Input preprocessor, command is given in environment variable TLVEOPEN.
+   If the command does not contain any shell syntax, it is executed directly,
+   otherwise it is run using shell
+ */
+
+/* characters which need a shell to be interpreted */
+#define SHELL_CHARS "|&;<>()$`\\\"'*?[]#~=!{}\n"
+
+/* maximum number of arguments for directly executed command */
+#define MAX_ARGS 64
+
+/* command split to arguments, NULL if shell must be used */
+static TLS char **args = NULL;
+static TLS int arg_count = 0;
+static TLS int args_checked = 0;
+
+/* split the preprocessor command to arguments, if command contains no shell syntax.
+   %s is allowed, it is replaced by the file name
+ */
+static void
+split_command()
+{
+    char *p,*s,*c;
+
+    args_checked = 1;
+
+    c = tlve_open;
+    while((c = strpbrk(c,SHELL_CHARS "%")) != NULL)
+    {
+        if(*c != '%') return;
+        if(c[1] != 's') return;
+        c += 2;
+    }
+
+    args = xmalloc(sizeof(char *) * (MAX_ARGS + 1));
+    p = xstrdup(tlve_open);
+
+    while(*p)
+    {
+        while(isspace(*p)) p++;
+        if(!*p) break;
+        s = p;
+        while(*p && !isspace(*p)) p++;
+        if(*p) *p++ = 0;
+        if(arg_count == MAX_ARGS)
+        {
+            free(args);
+            args = NULL;
+            return;
+        }
+        args[arg_count++] = s;
+    }
+    args[arg_count] = NULL;
+
+    if(!arg_count)
+    {
+        free(args);
+        args = NULL;
+    }
+}
+
+/* replace %s in argument with file name */
+static char *
+make_arg(char *arg,char *name)
+{
+    char *ret,*p;
+
+    p = strstr(arg,"%s");
+    if(p == NULL) return arg;
+
+    ret = xmalloc(strlen(arg) + strlen(name) + 1);
+    memcpy(ret,arg,(size_t) (p - arg));
+    strcpy(ret + (p - arg),name);
+    strcat(ret,p + 2);
+    return ret;
+}
+
+/* start the preprocessor for file name, return stream to read the
+   output of the preprocessor
+ */
+FILE *
+preproc_start(char *name)
+{
+#if defined(HAVE_WORKING_FORK) && defined(HAVE_DUP2) && defined(HAVE_PIPE)
+    int fds[2];
+    pid_t pid;
+    char *command;
+    char **argv = NULL;
+    int i;
+    FILE *fp;
+
+    if(!args_checked) split_command();
+
+    command = xmalloc(strlen(tlve_open) + strlen(name) + 1);
+    sprintf(command,tlve_open,name);
+
+    if(args != NULL)
+    {
+        argv = xmalloc(sizeof(char *) * (arg_count + 1));
+        for(i = 0;i <= arg_count;i++) argv[i] = args[i] != NULL ? make_arg(args[i],name) : NULL;
+    }
+
+    if (pipe(fds) != 0) panic("Cannot create pipe",strerror(errno),NULL);
+#if defined(F_SETFD) && defined(FD_CLOEXEC)
+    fcntl(fds[0],F_SETFD,FD_CLOEXEC);       // other preprocessors must not inherit this
+#endif
+    fflush(NULL);
+    pid = fork();
+    if(pid == (pid_t) 0) /* Child */
+    {
+        close(fds[0]);
+        if(dup2(fds[1],STDOUT_FILENO) == -1)
+        {
+            fprintf(stderr,"%s: dup2 error: %s\n",program_name,strerror(errno));
+            _exit(EXIT_FAILURE);
+        }
+        close(fds[1]);
+        if(argv != NULL)
+        {
+            execvp(argv[0],argv);
+        } else
+        {
+            execl(SHELL_CMD, "sh", "-c", command, NULL);
+        }
+        fprintf(stderr,"%s: Starting input preprocessor failed: %s; %s\n",program_name,command,strerror(errno));
+        _exit(EXIT_FAILURE);
+    } else if(pid < (pid_t) 0)
+    {
+        panic("Cannot fork",strerror(errno),NULL);
+    }
+
+    close(fds[1]);
+    fp = fdopen(fds[0],"r");
+    if(fp == NULL) panic("Cannot read from command",command,strerror(errno));
+
+    if(argv != NULL)
+    {
+        for(i = 0;i < arg_count;i++) if(argv[i] != args[i]) free(argv[i]);
+        free(argv);
+    }
+    free(command);
+    return fp;
+#else
+    panic("Input preprocessing is not supported in this system",NULL,NULL);
+    return NULL;
+#endif
+}
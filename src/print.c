@@ -27,6 +27,8 @@ struct print_list
     struct tlvitem *item;         // data to be printed
     int printed;                  // is the data printed or level header printed
     int trailer_printed;          // if constructor, tells is the trailer is also printed
+    int saved_printed;            // flags of the primary output while printing to an extra output
+    int saved_trailer_printed;
     struct print_list *next;             
 };
 
@@ -44,11 +46,11 @@ struct name
     int length;
 };
 
-static struct name name_list[MAX_NAME];
-static int name_count = 0;
+static TLS struct name *name_list = NULL;     // MAX_NAME entries, allocated when the first name is added
+static TLS int name_count = 0;
 
-static char *dump_buffer = NULL;
-static size_t dump_buffer_len = 0;
+static TLS char *dump_buffer = NULL;
+static TLS size_t dump_buffer_len = 0;
 /* expression list, used to select records */
 
 #define MAX_EXPRESSION 128
@@ -60,21 +62,63 @@ struct expression
 #if HAVE_REGEX
     regex_t reg;    // Compiled expression
 #endif
+    struct keyset *keys;    // values read from file, NULL for regular expression
+    struct matcher *matcher;  // plain string patterns of the same name, NULL if regexec is used
+    int matcher_leader;     // this expression scans the value for all in matcher
     int result;     // evaluation result
 };
 
 
-static struct expression expression_list[MAX_EXPRESSION];
-static int expression_count = 0;
-int expression_and = 0;                  // if true, all expressions must match, if not true one expression matching is enough
+static TLS struct expression *expression_list = NULL;   // MAX_EXPRESSION entries, allocated when needed
+static TLS int expression_count = 0;
+TLS int expression_and = 0;                  // if true, all expressions must match, if not true one expression matching is enough
 
 
 /* pointer to formatting function */
 typedef char *(pt_to_print)(char,struct tlvitem *,char *,char *);
 
-static struct print_list *print_list_start = NULL;
+static TLS struct print_list *print_list_start = NULL;
+static TLS struct print_list *print_list_free = NULL;   // purged items of all queries
 
-static FILE *ofp;   // output handle
+static TLS FILE *ofp;   // output handle
+
+/* Extra outputs, option -p NAME:OUTPUT.
+
+   Print list is printed to each extra output using its printing definition for all
+   elements, and then to the primary output. Printing decisions depend only on the
+   print list, so the printed flags are saved before printing to an extra output
+   and restored after it.
+ */
+#define MAX_OUTPUTS 16
+
+struct output
+{
+    char *print_name;
+    struct print *p;
+    char *file;
+    FILE *fp;
+};
+
+static TLS struct output outputs[MAX_OUTPUTS];
+static TLS int output_count = 0;
+static TLS struct print *output_print = NULL;   // printing definition for all elements, NULL = use definitions of elements
+
+/* Output sharding, %f in output name and option --shard NAME:COUNT.
+
+   Output name is a template: %f is replaced by the base name of the input file and
+   %n by the shard number. With %f a new output is opened for each input file. With
+   --shard a block is written to shard number hash(value of NAME) modulo COUNT,
+   so that the same value goes always to the same shard. Blocks without NAME go to
+   shard 0. File header and trailer are printed to each shard.
+ */
+#define SHARD_BUFFER_SIZE (256 * 1024)
+
+static TLS char *output_template = NULL;       // NULL = output is not a template
+static TLS FILE **shard_fps = NULL;            // open outputs of the template
+static TLS int shard_count = 0;                // 0 = no sharding by value
+static TLS unsigned char *shard_of = NULL;     // true if the tlv definition is the shard key, indexed by definition index
+static TLS unsigned long long shard_hash;      // hash of the key of the current block
+static TLS int shard_found = 0;                // key of the current block has been seen
 
 struct path_name
 {
@@ -84,13 +128,96 @@ struct path_name
 
 
 #define MAX_PATH_LEN (8 * 1024)
-static char path[MAX_PATH_LEN] = {0};       // name of the current path
+static TLS char path[MAX_PATH_LEN] = {0};       // name of the current path
                                   // structure.level1_name.level2_name.<level3_tag>.....
                                   // ends allways with dot
-static struct path_name path_names[MAX_LEVEL]; // Individual path names
-static int path_level = 0;
-static int start_print_level = 0;  // which is the first level to be printed, default is the first level
-static int stop_print_level = MAX_LEVEL;  // which is the last level to be printed, default is the MAX_LEVEL
+static TLS struct path_name path_names[MAX_LEVEL]; // Individual path names
+static TLS int path_level = 0;
+static TLS int start_print_level = 0;  // which is the first level to be printed, default is the first level
+static TLS int stop_print_level = MAX_LEVEL;  // which is the last level to be printed, default is the MAX_LEVEL
+static TLS FILE_OFFSET selected_blocks = 0;    // count of blocks selected by expressions and/or start level
+static TLS unsigned long printed_flushes = 0;   // buffer flush count when the print list was last printed
+
+/* Queries, option --queries.
+
+   A query has its own names, expressions, levels, printing definition and output.
+   Path of the current element is shared. State of a query is exchanged with the
+   state of the primary query (given in command line) when an element is given to
+   the query, so that the same functions serve all queries.
+ */
+struct query
+{
+    struct name *name_list;
+    int name_count;
+    struct expression *expression_list;
+    int expression_count;
+    int expression_and;
+    struct print_list *print_list_start;
+    FILE *ofp;
+    int output_count;
+    struct print *p;
+    struct print *output_print;
+    int start_print_level;
+    int stop_print_level;
+    FILE_OFFSET selected_blocks;
+    unsigned long printed_flushes;
+    char *output_template;
+    FILE **shard_fps;
+    int shard_count;
+};
+
+static TLS struct query *queries = NULL;
+static TLS int query_count = 0;
+static TLS int query_size = 0;
+static TLS int primary_disabled = 0;   // only the queries are run
+
+/* exchange the state of query q and the current state */
+static void
+query_swap(struct query *q)
+{
+    struct query t;
+
+    t.name_list = name_list;
+    t.name_count = name_count;
+    t.expression_list = expression_list;
+    t.expression_count = expression_count;
+    t.expression_and = expression_and;
+    t.print_list_start = print_list_start;
+    t.ofp = ofp;
+    t.output_count = output_count;
+    t.p = structure.p;
+    t.output_print = output_print;
+    t.start_print_level = start_print_level;
+    t.stop_print_level = stop_print_level;
+    t.selected_blocks = selected_blocks;
+    t.printed_flushes = printed_flushes;
+    t.output_template = output_template;
+    t.shard_fps = shard_fps;
+    t.shard_count = shard_count;
+
+    name_list = q->name_list;
+    name_count = q->name_count;
+    expression_list = q->expression_list;
+    expression_count = q->expression_count;
+    expression_and = q->expression_and;
+    print_list_start = q->print_list_start;
+    ofp = q->ofp;
+    output_count = q->output_count;
+    structure.p = q->p;
+    output_print = q->output_print;
+    start_print_level = q->start_print_level;
+    stop_print_level = q->stop_print_level;
+    selected_blocks = q->selected_blocks;
+    printed_flushes = q->printed_flushes;
+    output_template = q->output_template;
+    shard_fps = q->shard_fps;
+    shard_count = q->shard_count;
+
+    *q = t;
+}
+
+/* run statement s for each query and for the primary query */
+#define FOR_EACH_QUERY(s) do { int q_; for(q_ = 0;q_ < query_count;q_++) { query_swap(&queries[q_]); s; query_swap(&queries[q_]); } if(!primary_disabled) { s; } } while(0)
 
 void
 print_set_print_start_level(int level)
@@ -113,6 +240,7 @@ print_init_path()
 
     while(i < MAX_LEVEL)
     {
+        free(path_names[i].name);
         path_names[i].name = NULL;
         path_names[i].length = 0;
         i++;
@@ -154,6 +282,7 @@ static inline void
 print_list_writes(char *string)
 {
     if(fputs(string,ofp) == EOF) panic("Error writing to output",strerror(errno),NULL);
+    if(stats_enabled || profile_enabled) stats.output_bytes += (FILE_OFFSET) strlen(string);
 }
 
 /* write a char to output */
@@ -161,6 +290,7 @@ static inline void
 print_list_writec(char c)
 {
     if(fputc(c,ofp) == EOF) panic("Error writing to output",strerror(errno),NULL);
+    if(stats_enabled || profile_enabled) stats.output_bytes++;
 }
 
 /* return the items name, if nameis not defined (in with keyword tlv) return
@@ -171,7 +301,7 @@ print_list_writec(char c)
 static char *
 print_list_get_item_name(struct tlvitem *i)
 {
-    static char name[MAX_NAME];
+    static TLS char name[MAX_NAME];
     size_t tag_len;
 
     if(i->tlv != NULL && (i->tlv->name != NULL))
@@ -207,6 +337,8 @@ print_list_add_names(char *names)
         if(p > s)
         {
             *p = 0;
+            if(name_list == NULL) name_list = xmalloc(sizeof(struct name) * MAX_NAME);
+            if(name_count == MAX_NAME) panic("Too many names",s,NULL);
             name_list[name_count].name = xstrdup(s);
             name_list[name_count].length = strlen(s);
             name_count++;
@@ -221,6 +353,7 @@ reset_expression_result()
     register int i = expression_count;
 
     while(i) expression_list[--i].result = 0;
+    if(shard_count) shard_found = 0;     // key of the block is forgotten with the results
 }
 
 /* return true if the whole list contains true results */
@@ -256,6 +389,8 @@ print_list_add_expression(char *exp)
     value = strchr(exp,'=');
 
     if(!value) panic("An expression must contain =",exp,NULL);
+    if(expression_list == NULL) expression_list = xmalloc(sizeof(struct expression) * MAX_EXPRESSION);
+    if(expression_count == MAX_EXPRESSION) panic("Too many expressions",exp,NULL);
 
     name = exp;
     *value=0;
@@ -264,6 +399,9 @@ print_list_add_expression(char *exp)
     expression_list[expression_count].name = xstrdup(name);
     expression_list[expression_count].value = xstrdup(value);
     expression_list[expression_count].result = 0;
+    expression_list[expression_count].keys = NULL;
+    expression_list[expression_count].matcher = NULL;
+    expression_list[expression_count].matcher_leader = 0;
 
     //print_list_add_names(expression_list[expression_count].name);          
 
@@ -280,16 +418,49 @@ print_list_add_expression(char *exp)
     expression_count++;
 }
 
+/* Add expression having values in file, expression is in form NAME=FILE.
+   Expression is true if the converted_value of name is one of the values in file
+ */
+void
+print_list_add_key_expression(char *exp)
+{
+    char *value;
+
+    value = strchr(exp,'=');
+
+    if(!value) panic("An expression must contain =",exp,NULL);
+    if(expression_list == NULL) expression_list = xmalloc(sizeof(struct expression) * MAX_EXPRESSION);
+    if(expression_count == MAX_EXPRESSION) panic("Too many expressions",exp,NULL);
+
+    *value=0;
+    value++;
+
+    expression_list[expression_count].name = xstrdup(exp);
+    expression_list[expression_count].value = xstrdup(value);
+    expression_list[expression_count].result = 0;
+    expression_list[expression_count].keys = keyset_load(value);
+    expression_list[expression_count].matcher = NULL;
+    expression_list[expression_count].matcher_leader = 0;
+    expression_count++;
+}
+
 
-/* create list item at the end of the list */
+/* create list item at the end of the list, purged items are reused */
 static void
 print_list_add()
 {
     struct print_list *p,*n;
 
-    p = xmalloc(sizeof(struct print_list));
+    if(print_list_free != NULL)
+    {
+        p = print_list_free;
+        print_list_free = p->next;
+    } else
+    {
+        p = xmalloc(sizeof(struct print_list));
+        p->item = NULL;
+    }
 
-    p->item = NULL;
     p->printed = 0;
     p->trailer_printed = 0;
     p->next = NULL;
@@ -353,12 +524,11 @@ print_list_copy(struct tlvitem *i, struct print_list *p)
 }
 
 
-/* update the global path name down (new constructor)
+/* add a name to the end of the global path
    */
 void
-print_list_down(struct tlvitem *item)
+print_list_push_path(char *name)
 {
-    char *name = print_list_get_item_name(item);
     size_t ilen = strlen(name);
 
     if(path_level == MAX_LEVEL) panic("Too deep hierarchy",NULL,NULL);
@@ -379,6 +549,28 @@ print_list_down(struct tlvitem *item)
     path_level++;
 }
 
+/* update the global path name down (new constructor)
+   */
+void
+print_list_down(struct tlvitem *item)
+{
+    print_list_push_path(print_list_get_item_name(item));
+}
+
+/* return the number of names in current path */
+int
+print_list_path_level()
+{
+    return path_level;
+}
+
+/* return the name of the path in level, first is 0 */
+char *
+print_list_path_name(int level)
+{
+    return path_names[level].name;
+}
+
 /* update the global path name up (constructor data has been read)
    */
 void
@@ -388,6 +580,46 @@ print_list_up()
     if(path_level) path_level--;
 }
 
+#ifdef HAVE_REGEX
+/* collect the plain string expressions of each name to a matcher, so that
+   a value is scanned once instead of running regexec for each expression
+ */
+static void
+compile_matchers()
+{
+    struct matcher *m;
+    struct expression *e;
+    int i,j,leader;
+
+    for(i = 0;i < expression_count;i++)
+    {
+        if(expression_list[i].keys != NULL || expression_list[i].matcher != NULL) continue;
+
+        m = matcher_new();
+        leader = -1;
+        for(j = i;j < expression_count;j++)
+        {
+            e = &expression_list[j];
+            if(e->keys != NULL || e->matcher != NULL || STRCMP(e->name,expression_list[i].name) != 0) continue;
+            if(matcher_add(m,e->value,&e->result))
+            {
+                e->matcher = m;
+                if(leader < 0) leader = j;
+            }
+        }
+
+        if(leader >= 0)
+        {
+            matcher_compile(m);
+            expression_list[leader].matcher_leader = 1;
+        } else
+        {
+            free(m);
+        }
+    }
+}
+#endif
+
 /* check that names and expression names are in structure->tlv, so we do
    not start executing if name is misspelled
  */
@@ -434,6 +666,10 @@ print_list_check_names()
         }
         i++;
     }
+
+#ifdef HAVE_REGEX
+    compile_matchers();
+#endif
 }
 
 /* checks if item should be added to print list,
@@ -571,21 +807,26 @@ evaluate_expression(struct tlvitem *item)
 {
     register int i = 0;
     struct expression *e;
+    char *name = print_list_get_item_name(item);
 
-    while(i < expression_count)
+    while(i < expression_count && (e = find_expression(name,i)) != NULL)
     {
-        if((e = find_expression(print_list_get_item_name(item),i)) != NULL)
+        if(e->matcher != NULL)
+        {
+            if(e->matcher_leader) matcher_scan(e->matcher,item->converted_value);
+        } else if(e->keys != NULL)
         {
+            if(keyset_match(e->keys,item->converted_value)) e->result = 1;
+        } else
 #ifdef HAVE_REGEX
-            if(regexec(&e->reg,item->converted_value,(size_t) 0, NULL, 0) == 0) 
+        if(regexec(&e->reg,item->converted_value,(size_t) 0, NULL, 0) == 0) 
 #else
-            if(strcmp(e->value,item->converted_value) == 0) 
+        if(strcmp(e->value,item->converted_value) == 0) 
 #endif
-            {
-                if(!e->result) e->result = 1;
-            }
+        {
+            if(!e->result) e->result = 1;
         }
-        i++;
+        i = e - expression_list + 1;
     }
 }
 
@@ -619,12 +860,22 @@ print_list_clear_hold()
 }
 
 
+/* FNV-1a of the raw octets of the shard key */
+static unsigned long long
+shard_value_hash(BUFFER *v,size_t len)
+{
+    unsigned long long h = 14695981039346656037ULL;
+
+    while(len--) h = (h ^ *v++) * 1099511628211ULL;
+    return h;
+}
+
 /* add one item to print list */
 /* item is static so it will be copied to the list as the last one */
 /* if the last item is printed it will be reused */
 /* evaluates also expression */
-void
-print_list_add_item(struct tlvitem *item)
+static void
+print_list_add_item_one(struct tlvitem *item)
 {
     struct print_list *last_item = print_list_last();
 
@@ -649,12 +900,177 @@ print_list_add_item(struct tlvitem *item)
             if(item->tlv != NULL && item->tlv->hold_buffer != NULL) print_list_add_to_hold(item->tlv->hold_buffer,item->tlv->name);
             break;
     }
+
+    if(shard_count && !shard_found && item->tlv != NULL && item->tlv_type != T_CONSTRUCTED &&
+       shard_of[item->tlv->index] && item->level >= start_print_level)
+    {
+        shard_hash = shard_value_hash(item->raw_value,item->value_length);
+        shard_found = 1;
+    }
+}
+
+/* add item to the print lists of all queries */
+void
+print_list_add_item(struct tlvitem *item)
+{
+    FOR_EACH_QUERY(print_list_add_item_one(item));
+}
+
+/* route the blocks to shards by the value of element, arg is NAME:COUNT */
+void
+print_list_set_shard(char *arg)
+{
+    struct tlvlist *l;
+    char *name,*p;
+    int tlv_count = 0,found = 0;
+
+    name = xstrdup(arg);
+    p = strchr(name,':');
+    if(p == NULL) panic("Shard count is missing",arg,NULL);
+    *p++ = 0;
+    shard_count = atoi(p);
+    if(shard_count <= 0) panic("Shard count must be greater than zero",arg,NULL);
+
+    for(l = structure.tlv;l != NULL;l = l->next) tlv_count++;
+    shard_of = xcalloc((size_t) tlv_count + 1,sizeof(unsigned char));
+    for(l = structure.tlv;l != NULL;l = l->next)
+    {
+        if(l->tlv->name != NULL && STRCMP(l->tlv->name,name) == 0)
+        {
+            shard_of[l->tlv->index] = 1;
+            found++;
+        }
+    }
+    if(!found) panic("Name not found in tlv names",name,NULL);
+    free(name);
+
+    print_set_print_start_level(print_list_block_level());
+}
+
+/* make output name from template for input file and shard number */
+static char *
+output_name(char *input,int shard)
+{
+    char *base,*name,*s,*d;
+    int has_shard = 0;
+
+    if(input == NULL || (input[0] == '-' && !input[1]))
+    {
+        base = "stdin";
+    } else
+    {
+        base = strrchr(input,'/');
+        base = base != NULL ? base + 1 : input;
+    }
+
+    name = xmalloc(strlen(output_template) * (strlen(base) + 24) + 32);
+    for(s = output_template,d = name;*s;s++)
+    {
+        if(*s == '%' && s[1] == 'f')
+        {
+            d += sprintf(d,"%s",base);
+            s++;
+        } else if(*s == '%' && s[1] == 'n')
+        {
+            d += sprintf(d,"%d",shard);
+            has_shard = 1;
+            s++;
+        } else if(*s == '%' && s[1] == '%')
+        {
+            *d++ = '%';
+            s++;
+        } else
+        {
+            *d++ = *s;
+        }
+    }
+    *d = 0;
+
+    if(shard_count && !has_shard) sprintf(d,".%d",shard);
+    return name;
+}
+
+/* close the outputs of the template */
+static void
+close_shards()
+{
+    int i;
+
+    if(raw_output) raw_flush();
+    for(i = 0;i < (shard_count ? shard_count : 1);i++)
+    {
+        if(shard_fps[i] != NULL && fclose(shard_fps[i]) != 0) panic("Error closing output file",strerror(errno),NULL);
+        shard_fps[i] = NULL;
+    }
+    ofp = stdout;
+}
+
+/* open the outputs of the template for input file */
+static void
+open_shards(char *input)
+{
+    char *name;
+    int i;
+
+    close_shards();
+    for(i = 0;i < (shard_count ? shard_count : 1);i++)
+    {
+        name = output_name(input,i);
+        shard_fps[i] = xfopen(name,"w",'a');
+        setvbuf(shard_fps[i],NULL,_IOFBF,(size_t) SHARD_BUFFER_SIZE);
+        free(name);
+    }
+    ofp = shard_fps[0];
+}
+
+/* set the output to the shard of the current block */
+static void
+shard_select()
+{
+    FILE *fp = shard_fps[shard_found ? (int) (shard_hash % (unsigned long long) shard_count) : 0];
+
+    if(fp != ofp)
+    {
+        if(raw_output) raw_flush();     // pending blocks belong to the previous shard
+        ofp = fp;
+    }
+}
+
+static void
+print_list_file_output_one()
+{
+    printed_flushes = buffer_flush_count();
+    if(output_template != NULL && strstr(output_template,"%f") != NULL) open_shards(get_current_file_name());
+}
+
+/* new input file is opened, buffer has new data for all queries and outputs having %f in name are opened for it */
+void
+print_list_file_output()
+{
+    FOR_EACH_QUERY(print_list_file_output_one());
+}
+
+/* return true if output name is a template */
+int
+print_list_is_template(char *file)
+{
+    return shard_count || strstr(file,"%f") != NULL;
 }
 
 /* open the output file, "-" is stdout */
 void 
 print_list_open_output(char *file)
 {
+    if(print_list_is_template(file))
+    {
+        if(file[0] == '-' && !file[1]) panic("Output file name must be given for sharding",NULL,NULL);
+        output_template = xstrdup(file);
+        shard_fps = xcalloc((size_t) (shard_count ? shard_count : 1),sizeof(FILE *));
+        ofp = stdout;
+        if(strstr(file,"%f") == NULL) open_shards(NULL);
+        return;
+    }
+
     if(file[0] == '-' && !file[1])
     {
         ofp = stdout;
@@ -664,11 +1080,186 @@ print_list_open_output(char *file)
     }
 }
 
+/* open the output file for resuming, output data after offset is discarded,
+   "-" is stdout and it cannot be truncated
+ */
+void
+print_list_open_output_at(char *file,FILE_OFFSET offset)
+{
+    if((file[0] == '-' && !file[1]) || offset < (FILE_OFFSET) 0)
+    {
+        print_list_open_output(file);
+        return;
+    }
+
+    ofp = xfopen(file,"r+",'a');
+
+#if defined(HAVE_FTRUNCATE) && defined(HAVE_FSEEKO)
+    fflush(ofp);
+    if(ftruncate(fileno(ofp),(off_t) offset) != 0) panic("Cannot truncate output file",file,strerror(errno));
+    if(fseeko(ofp,(off_t) offset,SEEK_SET) != 0) panic("Cannot seek output file",file,strerror(errno));
+#else
+    panic("Resuming output is not supported in this system",NULL,NULL);
+#endif
+}
+
+/* flush the output and return the current output offset,
+   return -1 if output is not a regular file
+ */
+FILE_OFFSET
+print_list_output_offset()
+{
+    FILE_OFFSET ret = (FILE_OFFSET) -1;
+#if defined(HAVE_FSEEKO) && defined(HAVE_SYS_STAT_H)
+    struct stat st;
+
+    if(raw_output) raw_flush();
+    if(fflush(ofp) != 0) panic("Error writing to output",strerror(errno),NULL);
+#ifdef HAVE_FSYNC
+    if(ofp != stdout) fsync(fileno(ofp));
+#endif
+    if(ofp != stdout && fstat(fileno(ofp),&st) == 0 && S_ISREG(st.st_mode)) ret = (FILE_OFFSET) ftello(ofp);
+#endif
+    return ret;
+}
+
+/* return printing definition name */
+static struct print *
+find_print(char *name)
+{
+    struct print *p;
+
+    for(p = print;p != NULL && STRCMP(p->name,name) != 0;p = p->next);
+    if(p == NULL) panic("No printing definition named as",name,NULL);
+    return p;
+}
+
+/* start a new query, names, expressions, levels, printing definition and output
+   given after this belong to the query
+ */
+void
+print_list_begin_query()
+{
+    struct query *q;
+
+    if(query_count == query_size)
+    {
+        query_size = query_size ? 2 * query_size : 16;
+        queries = xrealloc(queries,sizeof(struct query) * query_size);
+    }
+
+    q = &queries[query_count];
+    memset(q,0,sizeof(struct query));
+    q->ofp = stdout;
+    q->p = structure.p;
+    q->stop_print_level = MAX_LEVEL;
+    query_swap(q);
+}
+
+/* check the query and continue with the primary query */
+void
+print_list_end_query()
+{
+    print_list_check_names();
+    query_swap(&queries[query_count++]);
+}
+
+/* use printing definition name for all elements of the query */
+void
+print_list_use_print(char *name)
+{
+    structure.p = output_print = find_print(name);
+}
+
+/* queries have been read, the primary query is run only if it selects something */
+void
+print_list_check_primary()
+{
+    if(!name_count && !expression_count && !start_print_level && stop_print_level == MAX_LEVEL) primary_disabled = 1;
+}
+
+/* return the output stream */
+FILE *
+print_list_output()
+{
+    return ofp;
+}
+
 /* close the output file */
 void 
 print_list_close_output()
 {
-    if(fclose(ofp) != 0) panic("Error closing output file",strerror(errno),NULL);
+    int i;
+
+    if(output_template != NULL)
+    {
+        close_shards();
+    } else
+    {
+        if(raw_output) raw_flush();
+        if(fclose(ofp) != 0) panic("Error closing output file",strerror(errno),NULL);
+    }
+
+    for(i = 0;i < output_count;i++)
+    {
+        if(fclose(outputs[i].fp) != 0) panic("Error closing output file",outputs[i].file,strerror(errno));
+    }
+
+    for(i = 0;i < query_count;i++)
+    {
+        if(queries[i].output_template != NULL)
+        {
+            query_swap(&queries[i]);
+            close_shards();
+            query_swap(&queries[i]);
+        } else if(queries[i].ofp != stdout && fclose(queries[i].ofp) != 0)
+        {
+            panic("Error closing output file",strerror(errno),NULL);
+        }
+    }
+}
+
+/* add an extra output, arg is NAME:OUTPUT */
+void
+print_list_add_output(char *arg)
+{
+    struct output *o;
+    char *c;
+
+    c = strchr(arg,':');
+    if(c == NULL || c == arg || !c[1]) panic("Printing definition and output must be given as NAME:OUTPUT",arg,NULL);
+    if(output_count == MAX_OUTPUTS) panic("Too many outputs",arg,NULL);
+
+    o = &outputs[output_count++];
+    o->print_name = xstrdup(arg);
+    o->print_name[c - arg] = 0;
+    o->file = o->print_name + (c - arg) + 1;
+    o->p = NULL;
+    o->fp = NULL;
+}
+
+/* resolve the printing definitions of the extra outputs and open them,
+   called after the configuration is read. Extra outputs are not saved in checkpoint
+ */
+void
+print_list_open_outputs(int resume)
+{
+    int i;
+
+    if(resume && output_count) panic("Output given with -p cannot be resumed",outputs[0].file,NULL);
+
+    for(i = 0;i < output_count;i++)
+    {
+        outputs[i].p = find_print(outputs[i].print_name);
+
+        if(outputs[i].file[0] == '-' && !outputs[i].file[1])
+        {
+            outputs[i].fp = stdout;
+        } else
+        {
+            outputs[i].fp = xfopen(outputs[i].file,"w",'a');
+        }
+    }
 }
 
 /* print indent */
@@ -721,7 +1312,7 @@ print_list_hex_dump(BUFFER *data,size_t length)
 static char *
 format_common(char c,struct tlvitem *i,char *fencoding, char *toencoding)
 {
-    static char number[128];
+    static TLS char number[128];
 
     switch(c)
     {
@@ -768,13 +1359,13 @@ format_common(char c,struct tlvitem *i,char *fencoding, char *toencoding)
             return structure.name;
             break;
         case 'd':
-            if(get_buffer_state() == S_BUFFER_OK) 
+            if(buffer_flush_count() == printed_flushes && i->raw_tl != NULL)     // no data for constructors restored from checkpoint
             {
                 return print_list_hex_dump(i->raw_tl,i->raw_tl_length);
             }
             break;
         case 'D':
-            if(get_buffer_state() == S_BUFFER_OK) 
+            if(buffer_flush_count() == printed_flushes && i->raw_value != NULL)
             {
                 return print_list_hex_dump(i->raw_value,i->raw_value_length);
             }
@@ -788,8 +1379,8 @@ format_common(char c,struct tlvitem *i,char *fencoding, char *toencoding)
 static char *
 trim(char *value)
 {
-    static char *trimmed = NULL;
-    static int tsize = 0;
+    static TLS char *trimmed = NULL;
+    static TLS int tsize = 0;
     char *p,*e;
     int value_len;
      
@@ -968,28 +1559,98 @@ print_item(struct tlvitem *i,char *data,char *indent,char *fencoding, char *toen
     }
 }
 
+/* print primitive item using printing definition pdata */
+void
+print_primitive_item(struct tlvitem *item,struct print *pdata)
+{
+    char *from,*to;
+
+    from = item->tlv != NULL && item->tlv->encoding != NULL ? item->tlv->encoding : NULL;
+    to = pdata->encoding != NULL ? pdata->encoding : codeset;
+    print_item(item,pdata->content,pdata->indent,from,to,format_primitive);
+}
+
+/* call print_function for each extra output and for the primary output,
+   if all_shards is true the primary output is each shard in turn
+ */
+static void
+print_outputs(void (*print_function)(),int all_shards)
+{
+    struct print_list *p;
+    struct print *primary_print = structure.p;
+    struct print *primary_output_print = output_print;
+    FILE *primary_fp = ofp;
+    int i;
+
+    for(i = 0;i < output_count;i++)
+    {
+        for(p = print_list_start;p != NULL;p = p->next)
+        {
+            p->saved_printed = p->printed;
+            p->saved_trailer_printed = p->trailer_printed;
+        }
+
+        structure.p = output_print = outputs[i].p;
+        ofp = outputs[i].fp;
+        print_function();
+
+        for(p = print_list_start;p != NULL;p = p->next)
+        {
+            p->printed = p->saved_printed;
+            p->trailer_printed = p->saved_trailer_printed;
+        }
+    }
+
+    structure.p = primary_print;
+    output_print = primary_output_print;
+    ofp = primary_fp;
+    if(all_shards && shard_count)
+    {
+        for(i = 0;i < shard_count;i++)
+        {
+            ofp = shard_fps[i];
+            print_function();
+        }
+        ofp = primary_fp;
+    } else
+    {
+        print_function();
+    }
+}
+
+static void
+print_file_header_one()
+{
+    print_item(NULL,structure.p->file_head,structure.p->indent,NULL,NULL,format_file);
+}
+
+static void
+print_file_trailer_one()
+{
+    print_item(NULL,structure.p->file_trailer,structure.p->indent,NULL,NULL,format_file);
+}
+
 /* print file header */
 void
 print_file_header()
 {
-    print_item(NULL,structure.p->file_head,structure.p->indent,NULL,NULL,format_file);
+    FOR_EACH_QUERY(print_outputs(print_file_header_one,1));
 }
 
 /* print file trailer */
 void
 print_file_trailer()
 {
-    print_item(NULL,structure.p->file_trailer,structure.p->indent,NULL,NULL,format_file);
+    FOR_EACH_QUERY(print_outputs(print_file_trailer_one,1));
 }
 
 /* Purge one item */
-/* item to purge is pitem */
+/* item to purge is pitem, it is kept for reuse with its value buffer */
 static void
 print_list_purge_item(struct print_list *pitem)
 {
-    if(pitem->item->converted_value_len) free(pitem->item->converted_value);
-    free(pitem->item);
-    free(pitem);
+    pitem->next = print_list_free;
+    print_list_free = pitem;
 }
 
 
@@ -1066,6 +1727,7 @@ print_list_separator(char separator)
 static struct print *
 print_list_print_data(struct print_list *pitem)
 {
+    if(output_print != NULL) return output_print;
     if(pitem->item->tlv != NULL)
     {
         if(pitem->item->tlv->p != NULL) return pitem->item->tlv->p;
@@ -1091,6 +1753,50 @@ print_list_printable()
 }
  
 
+/* return true if print list contains data not printed yet
+ */
+int
+print_list_pending()
+{
+    return print_list_printable();
+}
+
+/* return the n'th constructed item which has been printed but its level trailer is not,
+   first is 0. Return NULL if there is no such item
+ */
+struct tlvitem *
+print_list_open_constructor(int n)
+{
+    register struct print_list *p;
+
+    p = print_list_start;
+
+    while(p != NULL)
+    {
+        if(p->printed && !p->trailer_printed && p->item->tlv_type == T_CONSTRUCTED)
+        {
+            if(!n) return p->item;
+            n--;
+        }
+        p = p->next;
+    }
+    return NULL;
+}
+
+/* add a printed constructor to the end of the print list, so that its trailer
+   will be printed when the level ends. Used when restoring the parser state
+ */
+void
+print_list_restore_constructor(struct tlvitem *item)
+{
+    struct print_list *last_item;
+
+    print_list_add();
+    last_item = print_list_last();
+    print_list_copy(item,last_item);
+    last_item->printed = 1;
+}
+
 /* go through the print list and print the items
  */
 static void
@@ -1101,7 +1807,6 @@ print_list_do_print()
     struct print *pdata;
     struct tlvitem *item,*last_item = NULL;
     unsigned int prev_level = FIRST_LEVEL;
-    char *from,*to;
 
 
     p = print_list_start;
@@ -1116,7 +1821,9 @@ print_list_do_print()
                     (prev_c->item->level >= item->level))
             {
                 pdata = print_list_print_data(prev_c);
+                if(profile_enabled) profile_print_start();
                 print_item(prev_c->item,pdata->level_trailer,pdata->indent,NULL,NULL,format_level_trailer);
+                if(profile_enabled) profile_print_end(prev_c->item,pdata);
                 prev_c->trailer_printed = 1;
             }
         } 
@@ -1125,18 +1832,20 @@ print_list_do_print()
         {
             pdata = print_list_print_data(p);
 
+            if(profile_enabled) profile_print_start();
+
             switch(item->tlv_type)
             {
                 case T_CONSTRUCTED:
                     print_item(item,pdata->level_head,pdata->indent,NULL,NULL,format_level_head);
                     break;
                 default:
-                    from = item->tlv != NULL && item->tlv->encoding != NULL ? item->tlv->encoding : NULL;
-                    to = pdata->encoding != NULL ? pdata->encoding : codeset;
-                    print_item(item,pdata->content,pdata->indent,from,to,format_primitive);
+                    print_primitive_item(item,pdata);
                     if(p->next) print_list_separator(pdata->separator);
                     break;
             }
+
+            if(profile_enabled) profile_print_end(item,pdata);
             p->printed = 1;
         }
 
@@ -1149,18 +1858,95 @@ print_list_do_print()
             (prev_c->item->level >= get_current_level()))
     {
         pdata = print_list_print_data(prev_c);
+        if(profile_enabled) profile_print_start();
         print_item(prev_c->item,pdata->level_trailer,pdata->indent,NULL,NULL,format_level_trailer);
+        if(profile_enabled) profile_print_end(prev_c->item,pdata);
         prev_c->trailer_printed = 1;
     }
 
 }
 
 
-/* print the list */
+/* return the count of blocks selected by expressions and/or start level */
+FILE_OFFSET
+print_list_selected()
+{
+    return selected_blocks;
+}
+
+/* level of the first element in a block */
+int
+print_list_block_level()
+{
+    return start_print_level ? start_print_level : FIRST_LEVEL;
+}
+
+/* forget the elements and path of the current file, used when a file is not read to the end */
+static void
+print_list_reset_one()
+{
+    print_list_purge(1);
+    reset_expression_result();
+    path_level = 0;
+    path[0] = 0;
+}
+
+/* reset the print lists of all queries */
 void
-print_list_print()
+print_list_reset()
+{
+    FOR_EACH_QUERY(print_list_reset_one());
+}
+
+/* remove the items which are not yet printed, used when the rest of a block is lost after an error */
+static void
+print_list_drop_one()
+{
+    struct print_list *p = print_list_start,*prev = NULL,*next;
+
+    while(p != NULL)
+    {
+        next = p->next;
+        if(!p->printed)
+        {
+            if(prev == NULL)
+            {
+                print_list_start = next;
+            } else
+            {
+                prev->next = next;
+            }
+            print_list_purge_item(p);
+        } else
+        {
+            prev = p;
+        }
+        p = next;
+    }
+    reset_expression_result();
+}
+
+/* drop the unprinted items of all queries */
+void
+print_list_drop()
+{
+    FOR_EACH_QUERY(print_list_drop_one());
+}
+
+/* print the block selected by expressions and/or start level */
+static void
+print_list_print_block()
+{
+    int print_something = print_list_printable();
+
+    if(print_something) print_item(NULL,structure.p->block_start,structure.p->indent,NULL,NULL,format_file);
+    print_list_do_print();
+    if(print_something) print_item(NULL,structure.p->block_end,structure.p->indent,NULL,NULL,format_file);
+}
+
+static void
+print_list_print_one()
 {
-    int print_something;
 
     if(expression_count || start_print_level > 0)
     {
@@ -1168,24 +1954,38 @@ print_list_print()
         {
             if(eval_expression_results() || !expression_count)
             {
-                print_something = print_list_printable();
-
-                if(print_something) print_item(NULL,structure.p->block_start,structure.p->indent,NULL,NULL,format_file);
-                print_list_do_print();
-                if(print_something) print_item(NULL,structure.p->block_end,structure.p->indent,NULL,NULL,format_file);
+                selected_blocks++;
+                if(shard_count) shard_select();
+                if(raw_output)
+                {
+                    raw_write_block();
+                } else
+                {
+                    print_outputs(print_list_print_block,0);
+                }
             }
+            if(raw_output) raw_block_done();
             print_list_purge(1);
             buffer(B_PRINTED,0);
+            printed_flushes = buffer_flush_count();
             reset_expression_result();
         }
     } else
     {
-        print_list_do_print();
+        print_outputs(print_list_do_print,0);
         print_list_purge(0);
         buffer(B_PRINTED,0);
+        printed_flushes = buffer_flush_count();
     } 
 }
 
+/* print the lists of all queries */
+void
+print_list_print()
+{
+    FOR_EACH_QUERY(print_list_print_one());
+}
+
         
 
 
@@ -0,0 +1,382 @@
+/* 
+   tlve - A program to parse tag-length-value structures and print them in different formats
+
+   Copyright (C) 2009 Timo Savinen
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.  
+*/ 
+#include "tlve.h"
+
+/* Profiles of the input and of the configuration.
+
+   Cost profile of tlv and printing definitions, option --profile-defs.
+
+   Parsing, conversion and printing times and octets are attributed to the tlv
+   definition of the element and to the printing definition used. Counters are
+   arrays indexed by the index of the definition, elements without tlv definition
+   are counted in the last entry of the tlv array.
+ */
+
+struct def_cost
+{
+    FILE_OFFSET count;       // elements or printed items
+    FILE_OFFSET bytes;       // input octets for tlv definitions, output octets for printing definitions
+    long long parse_time;    // nanoseconds, includes the conversion time
+    long long convert_time;
+    long long print_time;
+};
+
+TLS int profile_enabled = 0;
+
+static TLS struct def_cost *tlv_costs = NULL;
+static TLS struct def_cost *print_costs = NULL;
+static TLS struct tlvdef **tlvs = NULL;
+static TLS struct print **prints = NULL;
+static TLS int tlv_count = 0;
+static TLS int print_count = 0;
+
+/* start values of the current print */
+static TLS long long print_start;
+static TLS FILE_OFFSET print_start_bytes;
+
+void
+profile_defs_enable()
+{
+    profile_enabled = 1;
+}
+
+/* allocate the counters, called after the configuration is read */
+void
+profile_init()
+{
+    struct tlvlist *l;
+    struct print *p;
+
+    if(!profile_enabled) return;
+
+    for(l = structure.tlv;l != NULL;l = l->next) tlv_count++;
+    for(p = print;p != NULL;p = p->next) print_count++;
+
+    tlvs = xmalloc(sizeof(struct tlvdef *) * (tlv_count + 1));
+    prints = xmalloc(sizeof(struct print *) * (print_count + 1));
+    tlv_costs = xcalloc((size_t) tlv_count + 1,sizeof(struct def_cost));
+    print_costs = xcalloc((size_t) print_count + 1,sizeof(struct def_cost));
+
+    for(l = structure.tlv;l != NULL;l = l->next) tlvs[l->tlv->index] = l->tlv;
+    for(p = print;p != NULL;p = p->next) prints[p->index] = p;
+}
+
+static inline struct def_cost *
+tlv_cost(struct tlvitem *item)
+{
+    return &tlv_costs[item->tlv != NULL ? item->tlv->index : tlv_count];
+}
+
+/* element has been parsed in time ns */
+void
+profile_element(struct tlvitem *item,long long ns)
+{
+    struct def_cost *c = tlv_cost(item);
+
+    c->count++;
+    c->bytes += (FILE_OFFSET) item->raw_tl_length;
+    if(item->tlv_type != T_CONSTRUCTED) c->bytes += (FILE_OFFSET) item->raw_value_length;
+    c->parse_time += ns;
+}
+
+/* value of the element has been converted in time ns */
+void
+profile_convert(struct tlvitem *item,long long ns)
+{
+    tlv_cost(item)->convert_time += ns;
+}
+
+void
+profile_print_start()
+{
+    print_start = stats_clock();
+    print_start_bytes = stats.output_bytes;
+}
+
+/* item has been printed using pdata */
+void
+profile_print_end(struct tlvitem *item,struct print *pdata)
+{
+    long long ns = stats_clock() - print_start;
+    FILE_OFFSET bytes = stats.output_bytes - print_start_bytes;
+    struct def_cost *c;
+
+    tlv_cost(item)->print_time += ns;
+
+    c = &print_costs[pdata->index];
+    c->count++;
+    c->bytes += bytes;
+    c->print_time += ns;
+}
+
+static long long
+total_time(struct def_cost *c)
+{
+    return c->parse_time + c->print_time;
+}
+
+/* qsort comparison, most expensive first */
+static int
+compare_tlv_costs(const void *a,const void *b)
+{
+    long long ta = total_time(&tlv_costs[*(const int *) a]);
+    long long tb = total_time(&tlv_costs[*(const int *) b]);
+
+    return ta < tb ? 1 : (ta > tb ? -1 : 0);
+}
+
+static int
+compare_print_costs(const void *a,const void *b)
+{
+    long long ta = print_costs[*(const int *) a].print_time;
+    long long tb = print_costs[*(const int *) b].print_time;
+
+    return ta < tb ? 1 : (ta > tb ? -1 : 0);
+}
+
+static double
+seconds(long long ns)
+{
+    return (double) ns / 1e9;
+}
+
+/* print the profile to standard error, definitions which were not used are not printed */
+void
+profile_report()
+{
+    int *order,i,j;
+    long long all = 0;
+    struct def_cost *c;
+    char *name;
+
+    if(!profile_enabled) return;
+
+    order = xmalloc(sizeof(int) * (tlv_count + print_count + 2));
+
+    for(i = 0;i <= tlv_count;i++)
+    {
+        order[i] = i;
+        all += total_time(&tlv_costs[i]);
+    }
+    if(!all) all = 1;
+    qsort(order,(size_t) tlv_count + 1,sizeof(int),compare_tlv_costs);
+
+    fprintf(stderr,"%s: tlv definition profile\n",program_name);
+    fprintf(stderr,"%-32s %12s %14s %10s %10s %10s %10s %6s\n","tlv","elements","octets","parse s","convert s","print s","total s","%");
+    for(i = 0;i <= tlv_count;i++)
+    {
+        j = order[i];
+        c = &tlv_costs[j];
+        if(!c->count) continue;
+        if(j == tlv_count)
+        {
+            name = "(no definition)";
+        } else
+        {
+            name = tlvs[j]->name != NULL ? tlvs[j]->name : tlvs[j]->stag;
+        }
+        fprintf(stderr,"%-32s %12lld %14lld %10.3f %10.3f %10.3f %10.3f %6.1f\n",name,
+                (long long) c->count,(long long) c->bytes,seconds(c->parse_time - c->convert_time),
+                seconds(c->convert_time),seconds(c->print_time),seconds(total_time(c)),
+                100.0 * (double) total_time(c) / (double) all);
+    }
+
+    for(i = 0;i < print_count;i++) order[i] = i;
+    qsort(order,(size_t) print_count,sizeof(int),compare_print_costs);
+
+    fprintf(stderr,"\n%s: printing definition profile\n",program_name);
+    fprintf(stderr,"%-32s %12s %14s %10s\n","print","items","octets","print s");
+    for(i = 0;i < print_count;i++)
+    {
+        c = &print_costs[order[i]];
+        if(!c->count) continue;
+        fprintf(stderr,"%-32s %12lld %14lld %10.3f\n",prints[order[i]]->name,
+                (long long) c->count,(long long) c->bytes,seconds(c->print_time));
+    }
+
+    free(order);
+}
+
+/* Tag tree profile, option --profile-tree.
+
+   Observed tag hierarchy is collected to a tree, every distinct path of tags
+   has one node. Elements are not printed, only the tree is printed at the end.
+ */
+
+/* value type guesses, bit is cleared when a value does not fit to the type */
+#define GUESS_STRING 1       // printable ASCII
+#define GUESS_BCD 2          // BCD digits, last octet may have filler F
+#define GUESS_INT 4          // at most 8 octets
+#define GUESS_ALL (GUESS_STRING | GUESS_BCD | GUESS_INT)
+
+struct tree_node
+{
+    char *tag;
+    struct tlvdef *tlv;
+    FILE_OFFSET count;
+    FILE_OFFSET constructed;       // count of constructed elements, others are primitive
+    FILE_OFFSET min_length;
+    FILE_OFFSET max_length;
+    FILE_OFFSET total_length;
+    int guesses;                   // GUESS_* bits valid for all primitive values
+    struct tree_node *children;    // in order of first appearance
+    struct tree_node *last_child;
+    struct tree_node *next;
+};
+
+TLS int profile_tree = 0;
+
+static TLS struct tree_node tree_root;
+
+/* current node in each level */
+static TLS struct tree_node *tree_path[MAX_LEVEL + FIRST_LEVEL];
+
+void
+profile_tree_enable()
+{
+    profile_tree = 1;
+}
+
+/* return the type guesses for a value */
+static int
+value_guesses(BUFFER *v,size_t len)
+{
+    int g = GUESS_ALL;
+    size_t i;
+
+    if(len > sizeof(long long int)) g &= ~GUESS_INT;
+
+    for(i = 0;i < len && (g & (GUESS_STRING | GUESS_BCD));i++)
+    {
+        if(v[i] < 0x20 || v[i] > 0x7e) g &= ~GUESS_STRING;
+        if((v[i] >> 4) > 9 || ((v[i] & 0x0f) > 9 && !(i == len - 1 && (v[i] & 0x0f) == 0x0f))) g &= ~GUESS_BCD;
+    }
+    return g;
+}
+
+static char *
+guess_name(struct tree_node *n)
+{
+    if(n->constructed == n->count) return "";
+    if(n->guesses & GUESS_STRING) return "string";
+    if(n->guesses & GUESS_BCD) return "bcd";
+    if(n->guesses & GUESS_INT) return "int";
+    return "hex";
+}
+
+/* find child node having tag, create a new if not found */
+static struct tree_node *
+tree_child(struct tree_node *parent,char *tag)
+{
+    struct tree_node *n;
+
+    for(n = parent->children;n != NULL;n = n->next)
+    {
+        if(strcmp(n->tag,tag) == 0) return n;
+    }
+
+    n = xcalloc((size_t) 1,sizeof(struct tree_node));
+    n->tag = xstrdup(tag);
+    n->guesses = GUESS_ALL;
+    if(parent->last_child == NULL)
+    {
+        parent->children = n;
+    } else
+    {
+        parent->last_child->next = n;
+    }
+    parent->last_child = n;
+    return n;
+}
+
+/* add a parsed element to the tree */
+void
+profile_tree_add(struct tlvitem *item)
+{
+    struct tree_node *parent,*n;
+    FILE_OFFSET length;
+
+    parent = item->level > FIRST_LEVEL ? tree_path[item->level - 1] : &tree_root;
+    if(parent == NULL) parent = &tree_root;
+
+    n = tree_child(parent,item->tag);
+    if(n->tlv == NULL) n->tlv = item->tlv;
+
+    if(item->tlv_type == T_CONSTRUCTED)
+    {
+        n->constructed++;
+        length = item->length;
+        tree_path[item->level] = n;
+    } else
+    {
+        length = (FILE_OFFSET) item->value_length;
+        if(n->guesses) n->guesses &= value_guesses(item->raw_value,item->value_length);
+    }
+
+    if(!n->count || length < n->min_length) n->min_length = length;
+    if(length > n->max_length) n->max_length = length;
+    n->total_length += length;
+    n->count++;
+}
+
+static void
+tree_print(FILE *fp,struct tree_node *n,int depth)
+{
+    char tag[MAX_TAG_SIZE * 2];
+    char *form;
+
+    for(;n != NULL;n = n->next)
+    {
+        if(n->tlv != NULL && n->tlv->name != NULL)
+        {
+            snprintf(tag,sizeof(tag),"%*s%s %s",2 * depth,"",n->tag,n->tlv->name);
+        } else
+        {
+            snprintf(tag,sizeof(tag),"%*s%s",2 * depth,"",n->tag);
+        }
+
+        if(!n->constructed)
+        {
+            form = "P";
+        } else if(n->constructed == n->count)
+        {
+            form = "C";
+        } else
+        {
+            form = "C+P";
+        }
+
+        fprintf(fp,"%-48s %12lld %-4s %10lld %10lld %12.1f %s\n",tag,(long long) n->count,form,
+                (long long) n->min_length,(long long) n->max_length,
+                (double) n->total_length / (double) n->count,guess_name(n));
+
+        tree_print(fp,n->children,depth + 1);
+    }
+}
+
+/* print the tag tree to fp */
+void
+profile_tree_report(FILE *fp)
+{
+    if(!profile_tree) return;
+
+    fprintf(fp,"%-48s %12s %-4s %10s %10s %12s %s\n","tag","count","form","min len","max len","avg len","value");
+    tree_print(fp,tree_root.children,0);
+}
@@ -0,0 +1,118 @@
+/* 
+   tlve - A program to parse tag-length-value structures and print them in different formats
+
+   Copyright (C) 2009 Timo Savinen
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.  
+*/ 
+#include "tlve.h"
+
+/* Progress reporting. Signal handlers only set progress_requested, which is
+   checked in the main loop after every element. The report is printed to
+   standard error on SIGUSR1 and every interval seconds when --progress is given.
+ */
+
+/* set by signal handler, not thread local because signals are process wide */
+volatile sig_atomic_t progress_requested = 0;
+
+/* seconds between reports, 0 = only on signal */
+static int progress_interval = 0;
+
+/* time when the processing was started, nanoseconds */
+static long long progress_start_time;
+
+static void
+progress_signal(int sig)
+{
+    progress_requested = 1;
+#ifdef SIGALRM
+    if(sig == SIGALRM && progress_interval) alarm((unsigned int) progress_interval);
+#endif
+}
+
+static void
+progress_catch(int sig)
+{
+#ifdef HAVE_SIGACTION
+    struct sigaction act;
+
+    sigemptyset(&act.sa_mask);
+    act.sa_handler = progress_signal;
+    act.sa_flags = SA_RESTART;
+    sigaction(sig,&act,NULL);
+#else
+    signal(sig,progress_signal);
+#endif
+}
+
+/* report progress every seconds seconds */
+void
+progress_set_interval(int seconds)
+{
+    if(seconds <= 0) panic("Progress interval must be greater than zero",NULL,NULL);
+    progress_interval = seconds;
+}
+
+/* start catching the signals, call this when the processing starts */
+void
+progress_start()
+{
+    progress_start_time = stats_clock();
+#ifdef SIGUSR1
+    progress_catch(SIGUSR1);
+#endif
+#ifdef SIGALRM
+    if(progress_interval)
+    {
+        progress_catch(SIGALRM);
+        alarm((unsigned int) progress_interval);
+    }
+#endif
+}
+
+/* print the progress report to standard error */
+void
+progress_report()
+{
+    FILE_OFFSET done,total,elements = 0;
+    double elapsed,rate;
+    int i;
+
+    progress_requested = 0;
+
+    elapsed = (double) (stats_clock() - progress_start_time) / 1e9;
+    if(elapsed <= 0) elapsed = 1e-9;
+
+    for(i = FIRST_LEVEL;i <= MAX_LEVEL;i++) elements += stats.elements[i];
+
+    input_progress(&done,&total);
+    rate = (double) done / elapsed;
+
+    fprintf(stderr,"%s: %s",program_name,get_current_file_name());
+    if(total >= (FILE_OFFSET) 0)
+    {
+        fprintf(stderr,", %lld of %lld octets (%.1f %%)",(long long) done,(long long) total,
+                total ? 100.0 * (double) done / (double) total : 100.0);
+    } else
+    {
+        fprintf(stderr,", %lld octets",(long long) total_offset());
+    }
+    fprintf(stderr,", %.1f MB/s, %.0f elements/s",(double) total_offset() / elapsed / 1e6,(double) elements / elapsed);
+    if(total >= (FILE_OFFSET) 0 && rate > 0)
+    {
+        fprintf(stderr,", ETA %.0f s",(double) (total - done) / rate);
+    }
+    fprintf(stderr,"\n");
+}
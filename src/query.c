@@ -0,0 +1,208 @@
+/* 
+   tlve - A program to parse tag-length-value structures and print them in different formats
+
+   Copyright (C) 2009 Timo Savinen
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.  
+*/ 
+#include "tlve.h"
+
+/* Query file, option --queries.
+
+   Each line of the file is one query given with options -n, -e, -E, -a, -l, -L, -p
+   and -o as in the command line, e.g.
+
+   -l 3 -e Imsi=^24405 -n Imsi,Msisdn -p call -o finnish.csv
+
+   All queries are evaluated while the input is parsed once. Empty lines and lines
+   starting with # are ignored, arguments containing spaces can be quoted with ' or ".
+ */
+
+#define MAX_QUERY_ARGS 256
+
+struct query_option
+{
+    char *name;              // long name
+    char option;             // short name
+    int has_arg;
+};
+
+static struct query_option query_options[] =
+{
+    {"name-list",'n',1},
+    {"expression",'e',1},
+    {"expression-file",'E',1},
+    {"and",'a',0},
+    {"start-level",'l',1},
+    {"stop-level",'L',1},
+    {"print",'p',1},
+    {"output",'o',1},
+    {NULL,0,0}
+};
+
+/* split line to arguments in place, return the count of arguments */
+static int
+split_line(char *line,char **args,char *file)
+{
+    int count = 0;
+    char *to,quote;
+
+    while(*line)
+    {
+        while(isspace((unsigned char) *line)) line++;
+        if(!*line || (*line == '#' && !count)) break;
+        if(count == MAX_QUERY_ARGS) panic("Too many arguments in query",file,NULL);
+
+        args[count++] = to = line;
+        quote = 0;
+        while(*line && (quote || !isspace((unsigned char) *line)))
+        {
+            if(quote && *line == quote)
+            {
+                quote = 0;
+            } else if(!quote && (*line == '\'' || *line == '"'))
+            {
+                quote = *line;
+            } else
+            {
+                *to++ = *line;
+            }
+            line++;
+        }
+        if(quote) panic("Unterminated quote in query file",file,NULL);
+        if(*line) line++;
+        *to = 0;
+    }
+    return count;
+}
+
+/* apply one option to the current query */
+static void
+query_option(char option,char *arg)
+{
+    switch(option)
+    {
+        case 'n':
+            print_list_add_names(arg);
+            break;
+        case 'e':
+            print_list_add_expression(arg);
+            break;
+        case 'E':
+            print_list_add_key_expression(arg);
+            break;
+        case 'a':
+            expression_and = 1;
+            break;
+        case 'l':
+            print_set_print_start_level(atoi(arg));
+            break;
+        case 'L':
+            print_set_print_stop_level(atoi(arg));
+            break;
+        case 'p':
+            print_list_use_print(arg);
+            break;
+        case 'o':
+            print_list_open_output(arg);
+            break;
+    }
+}
+
+/* parse the arguments of one query */
+static void
+query_parse(int argc,char **args,char *file)
+{
+    struct query_option *o = NULL;
+    char *arg,*eq;
+    int i;
+
+    for(i = 0;i < argc;i++)
+    {
+        arg = NULL;
+        if(args[i][0] == '-' && args[i][1] == '-')
+        {
+            eq = strchr(args[i],'=');
+            if(eq != NULL)
+            {
+                *eq = 0;
+                arg = eq + 1;
+            }
+            for(o = query_options;o->name != NULL && strcmp(o->name,args[i] + 2) != 0;o++);
+        } else if(args[i][0] == '-' && args[i][1])
+        {
+            for(o = query_options;o->name != NULL && o->option != args[i][1];o++);
+            if(args[i][2]) arg = args[i] + 2;
+        } else
+        {
+            panic("Invalid argument in query file",args[i],file);
+        }
+
+        if(o == NULL || o->name == NULL) panic("Invalid option in query file",args[i],file);
+
+        if(o->has_arg && arg == NULL)
+        {
+            if(++i == argc) panic("Option requires an argument in query file",args[i - 1],file);
+            arg = args[i];
+        }
+        query_option(o->option,arg);
+    }
+}
+
+/* read the queries from file */
+void
+query_load(char *file)
+{
+    FILE *fp;
+    char *line = NULL;
+    char *args[MAX_QUERY_ARGS];
+    size_t line_size = 0,len = 0;
+    int c,argc;
+
+    fp = xfopen(file,"r",'a');
+    do
+    {
+        c = getc(fp);
+        if(c == '\n' || c == EOF)
+        {
+            if(len)
+            {
+                line[len] = 0;
+                argc = split_line(line,args,file);
+                if(argc)
+                {
+                    print_list_begin_query();
+                    query_parse(argc,args,file);
+                    print_list_end_query();
+                }
+            }
+            len = 0;
+        } else
+        {
+            if(len + 1 >= line_size)
+            {
+                line_size = line_size ? 2 * line_size : 256;
+                line = xrealloc(line,line_size);
+            }
+            line[len++] = (char) c;
+        }
+    } while(c != EOF);
+
+    if(ferror(fp)) panic("Error in reading file",file,strerror(errno));
+    fclose(fp);
+    free(line);
+
+    print_list_check_primary();
+}
@@ -0,0 +1,283 @@
+/* 
+   tlve - A program to parse tag-length-value structures and print them in different formats
+
+   Copyright (C) 2009 Timo Savinen
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.  
+*/ 
+#include "tlve.h"
+
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+
+/* Raw output, option --raw.
+
+   Selected blocks are written to output as they are in the input, octets are
+   not converted or formatted. When the input is a regular file read without
+   decompression or preprocessor the octets are copied from the input file to the
+   output by the kernel using copy_file_range or sendfile, if these are not
+   available or fail the octets are read with pread. Otherwise the octets read
+   from input are captured by the buffer and written from there.
+
+   Adjacent blocks from input file are copied with one call, pending blocks are
+   copied when a block is not adjacent, at the end of the file and when the output
+   is flushed.
+
+   Splitting, options --split and --split-records, writes all blocks to chunk files
+   NAME.1, NAME.2, ... where NAME is the output file. Elements outside of blocks are
+   not written, so each chunk contains a sequence of complete blocks. A new chunk is
+   started before a block which would make the chunk larger than the size limit or
+   when the chunk has the maximum count of blocks.
+ */
+
+#define COPY_RANGE 0
+#define COPY_SENDFILE 1
+#define COPY_READ 2
+
+#define COPY_CHUNK (1024 * 1024)
+
+TLS int raw_output = 0;
+TLS int splitting = 0;
+
+static TLS int input_fd = -1;            // input descriptor for direct copy, -1 = use captured octets
+static TLS int raw_level;                // level of the first element of a block
+static TLS FILE_OFFSET block_start;      // file offset of the current block
+static TLS int block_done;               // current block has been written or rejected
+static TLS int copy_method = COPY_RANGE; // first method to try, methods which fail are not tried again
+static TLS BUFFER *copy_buffer = NULL;
+static TLS FILE_OFFSET pending_start;    // adjacent blocks are copied at once
+static TLS FILE_OFFSET pending_len = 0;
+
+static TLS FILE_OFFSET split_size = 0;      // maximum octets in chunk, 0 = no limit
+static TLS FILE_OFFSET split_records = 0;   // maximum blocks in chunk, 0 = no limit
+static TLS char *split_name = NULL;
+static TLS char *chunk_name = NULL;
+static TLS FILE *chunk_fp = NULL;          // current chunk, NULL before the first block
+static TLS int chunk_index = 0;
+static TLS FILE_OFFSET chunk_size;
+static TLS FILE_OFFSET chunk_records;
+
+/* blocks start from the first level if start level is not given */
+void
+raw_enable()
+{
+    raw_output = 1;
+    print_set_print_start_level(print_list_block_level());
+}
+
+/* output for blocks */
+static FILE *
+raw_output_file()
+{
+    return chunk_fp != NULL ? chunk_fp : print_list_output();
+}
+
+/* new input file has been opened */
+void
+raw_file_start()
+{
+    if(!raw_output && !splitting) return;
+
+    raw_level = print_list_block_level();
+    block_start = file_offset();
+    block_done = 0;
+#if defined(HAVE_PREAD)
+    input_fd = buffer_input_fd();
+#endif
+    buffer_capture(input_fd < 0);
+}
+
+/* element has been parsed, remember the start of a block */
+void
+raw_item(struct tlvitem *item)
+{
+    if(item->level != raw_level || item->tlv_type == T_EOC) return;
+
+    block_start = item->file_offset;
+    block_done = 0;
+    if(input_fd < 0) buffer_capture_drop(block_start);
+}
+
+static void
+raw_write(BUFFER *data,size_t len)
+{
+    if(fwrite(data,(size_t) 1,len,raw_output_file()) != len) panic("Error writing output",strerror(errno),NULL);
+}
+
+#if defined(HAVE_PREAD)
+/* copy len octets starting from offset in input file to output */
+static void
+raw_copy(FILE_OFFSET offset,FILE_OFFSET len)
+{
+    int out;
+    ssize_t n = 0;
+    off_t off;
+
+    out = fileno(raw_output_file());
+    if(fflush(raw_output_file()) != 0) panic("Error writing output",strerror(errno),NULL);
+
+    while(len > (FILE_OFFSET) 0)
+    {
+        switch(copy_method)
+        {
+            case COPY_RANGE:
+#ifdef HAVE_COPY_FILE_RANGE
+                off = (off_t) offset;
+                n = copy_file_range(input_fd,&off,out,NULL,(size_t) len,0);
+                if(n > 0) break;
+#endif
+                copy_method = COPY_SENDFILE;       // e.g. output is a terminal or in an other file system
+                continue;
+            case COPY_SENDFILE:
+#if defined(HAVE_SYS_SENDFILE_H) && defined(HAVE_SENDFILE)
+                off = (off_t) offset;
+                n = sendfile(out,input_fd,&off,(size_t) len);
+                if(n > 0) break;
+#endif
+                copy_method = COPY_READ;
+                continue;
+            default:
+                if(copy_buffer == NULL) copy_buffer = xmalloc((size_t) COPY_CHUNK);
+                n = pread(input_fd,copy_buffer,len < (FILE_OFFSET) COPY_CHUNK ? (size_t) len : (size_t) COPY_CHUNK,(off_t) offset);
+                if(n < 0) panic("Error reading input file",get_current_file_name(),strerror(errno));
+                if(n == 0) panic("Input file has been truncated",get_current_file_name(),NULL);
+                raw_write(copy_buffer,(size_t) n);
+                break;
+        }
+        offset += (FILE_OFFSET) n;
+        len -= (FILE_OFFSET) n;
+    }
+}
+#endif
+
+/* copy the pending blocks to output */
+void
+raw_flush()
+{
+#if defined(HAVE_PREAD)
+    if(pending_len) raw_copy(pending_start,pending_len);
+#endif
+    pending_len = 0;
+}
+
+/* write the current block, the block ends at the current file offset */
+void
+raw_write_block()
+{
+    FILE_OFFSET len = file_offset() - block_start;
+    BUFFER *data;
+    size_t n;
+
+    if(block_done || len <= (FILE_OFFSET) 0) return;
+
+    if(stats_enabled || profile_enabled) stats.output_bytes += len;
+
+    if(input_fd >= 0)
+    {
+        if(pending_len && pending_start + pending_len == block_start)
+        {
+            pending_len += len;
+        } else
+        {
+            raw_flush();
+            pending_start = block_start;
+            pending_len = len;
+        }
+        return;
+    }
+
+    data = buffer_captured(block_start,&n);
+    raw_write(data,n);
+}
+
+/* block has been written or rejected, captured octets are not needed anymore */
+void
+raw_block_done()
+{
+    block_done = 1;
+    if(input_fd < 0) buffer_capture_drop(file_offset());
+}
+
+/* chunk size limit, in octets */
+void
+raw_set_split_size(FILE_OFFSET size)
+{
+    if(size <= (FILE_OFFSET) 0) panic("Split size must be greater than zero",NULL,NULL);
+    split_size = size;
+    splitting = 1;
+}
+
+/* chunk limit, in blocks */
+void
+raw_set_split_records(FILE_OFFSET count)
+{
+    if(count <= (FILE_OFFSET) 0) panic("Split record count must be greater than zero",NULL,NULL);
+    split_records = count;
+    splitting = 1;
+}
+
+/* chunks are named after output file name */
+void
+raw_split_start(char *name)
+{
+    if(name[0] == '-' && !name[1]) panic("Output file name must be given for splitting",NULL,NULL);
+    split_name = xstrdup(name);
+    chunk_name = xmalloc(strlen(name) + 24);
+}
+
+/* close the current chunk and report it as name, block count and size */
+static void
+close_chunk()
+{
+    if(chunk_fp == NULL) return;
+
+    raw_flush();
+    if(fclose(chunk_fp) != 0) panic("Error closing output file",chunk_name,strerror(errno));
+    chunk_fp = NULL;
+    fprintf(print_list_output(),"%s\t%lld\t%lld\n",chunk_name,(long long) chunk_records,(long long) chunk_size);
+}
+
+/* block starting from file offset start has been read, write it to the current or to a new chunk */
+void
+raw_split_block(FILE_OFFSET start)
+{
+    FILE_OFFSET len = file_offset() - start;
+
+    if(chunk_fp == NULL || (split_size && chunk_size && chunk_size + len > split_size) ||
+       (split_records && chunk_records >= split_records))
+    {
+        close_chunk();
+        sprintf(chunk_name,"%s.%d",split_name,++chunk_index);
+        chunk_fp = xfopen(chunk_name,"w",'b');
+        chunk_size = (FILE_OFFSET) 0;
+        chunk_records = (FILE_OFFSET) 0;
+    }
+
+    chunk_size += len;
+    chunk_records++;
+
+    block_start = start;
+    block_done = 0;
+    raw_write_block();
+    raw_block_done();
+}
+
+/* all input has been read */
+void
+raw_split_end()
+{
+    close_chunk();
+}
@@ -0,0 +1,429 @@
+/* 
+   tlve - A program to parse tag-length-value structures and print them in different formats
+
+   Copyright (C) 2009 Timo Savinen
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.  
+*/ 
+#include "tlve.h"
+
+#include <math.h>
+
+/* Approximate sketches of element values, options --top, --distinct and --sketch-per-file.
+
+   Memory used by a sketch does not depend on the input size.
+
+   Top-K uses the Space-Saving algorithm: K counters are kept in a min-heap, a value
+   which is not monitored replaces the value having the smallest count. Count of a
+   value is overestimated at most by the error printed with it.
+
+   Distinct count uses HyperLogLog with 2^HLL_PRECISION registers, standard error
+   is about 0.8 %.
+
+   Values are compared using their raw octets, only the values kept by top-K are converted.
+ */
+
+#define MAX_SKETCHES 32
+#define DEFAULT_TOP 100
+
+#define HLL_PRECISION 14
+#define HLL_REGISTERS (1 << HLL_PRECISION)
+
+#define S_TOP 0
+#define S_DISTINCT 1
+
+/* monitored value of top-K */
+struct top_entry
+{
+    BUFFER *key;
+    size_t key_len;
+    size_t key_size;
+    unsigned long long hash;
+    char *text;              // converted value
+    size_t text_size;
+    FILE_OFFSET count;
+    FILE_OFFSET error;       // maximum overestimation of count
+    int heap_pos;
+    struct top_entry *next;  // hash chain
+};
+
+struct sketch
+{
+    int type;                // S_*
+    char *name;              // element name
+    int k;                   // count of values for top-K
+    int used;                // entries in use
+    struct top_entry *entries;
+    struct top_entry **heap; // min-heap by count
+    struct top_entry **table;
+    size_t table_size;
+    unsigned char *registers;  // HyperLogLog registers
+};
+
+TLS int sketching = 0;
+
+static TLS struct sketch sketches[MAX_SKETCHES];
+static TLS int sketch_count = 0;
+static TLS int sketch_per_file = 0;
+
+/* bit mask of sketches using the tlv definition, indexed by definition index */
+static TLS unsigned int *sketches_of = NULL;
+
+static struct sketch *
+new_sketch(int type,char *name)
+{
+    struct sketch *s;
+
+    if(sketch_count == MAX_SKETCHES) panic("Too many sketches",name,NULL);
+    s = &sketches[sketch_count++];
+    memset(s,0,sizeof(struct sketch));
+    s->type = type;
+    s->name = xstrdup(name);
+    sketching = 1;
+    return s;
+}
+
+/* top-K of values of element, arg is NAME[:K] */
+void
+sketch_add_top(char *arg)
+{
+    struct sketch *s;
+    char *p;
+
+    s = new_sketch(S_TOP,arg);
+    s->k = DEFAULT_TOP;
+    p = strchr(s->name,':');
+    if(p != NULL)
+    {
+        *p++ = 0;
+        s->k = atoi(p);
+        if(s->k <= 0) panic("Top count must be greater than zero",arg,NULL);
+    }
+}
+
+/* distinct count of values of element */
+void
+sketch_add_distinct(char *name)
+{
+    new_sketch(S_DISTINCT,name);
+}
+
+/* report and clear the sketches after each input file */
+void
+sketch_set_per_file()
+{
+    sketch_per_file = 1;
+}
+
+static void
+sketch_clear(struct sketch *s)
+{
+    if(s->type == S_TOP)
+    {
+        s->used = 0;
+        memset(s->table,0,s->table_size * sizeof(struct top_entry *));
+    } else
+    {
+        memset(s->registers,0,(size_t) HLL_REGISTERS);
+    }
+}
+
+/* resolve the names and allocate the sketches, called after the configuration is read */
+void
+sketch_init()
+{
+    struct tlvlist *l;
+    struct sketch *s;
+    int tlv_count = 0,i,found;
+
+    if(!sketching) return;
+
+    for(l = structure.tlv;l != NULL;l = l->next) tlv_count++;
+    sketches_of = xcalloc((size_t) tlv_count + 1,sizeof(unsigned int));
+
+    for(i = 0;i < sketch_count;i++)
+    {
+        s = &sketches[i];
+        found = 0;
+        for(l = structure.tlv;l != NULL;l = l->next)
+        {
+            if(l->tlv->name != NULL && STRCMP(l->tlv->name,s->name) == 0)
+            {
+                sketches_of[l->tlv->index] |= 1U << i;
+                found++;
+            }
+        }
+        if(!found) panic("Name not found in tlv names",s->name,NULL);
+
+        if(s->type == S_TOP)
+        {
+            s->entries = xcalloc((size_t) s->k,sizeof(struct top_entry));
+            s->heap = xmalloc(sizeof(struct top_entry *) * s->k);
+            for(s->table_size = 16;s->table_size < 2 * (size_t) s->k;s->table_size *= 2);
+            s->table = xmalloc(sizeof(struct top_entry *) * s->table_size);
+        } else
+        {
+            s->registers = xmalloc((size_t) HLL_REGISTERS);
+        }
+        sketch_clear(s);
+    }
+}
+
+/* FNV-1a with final mixing, HyperLogLog needs well distributed high bits */
+static unsigned long long
+value_hash(BUFFER *v,size_t len)
+{
+    unsigned long long h = 14695981039346656037ULL;
+
+    while(len--) h = (h ^ *v++) * 1099511628211ULL;
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb3f99ed4e9ebULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static inline void
+heap_set(struct sketch *s,int pos,struct top_entry *e)
+{
+    s->heap[pos] = e;
+    e->heap_pos = pos;
+}
+
+static void
+heap_up(struct sketch *s,int pos)
+{
+    struct top_entry *e = s->heap[pos];
+    int parent;
+
+    while(pos > 0)
+    {
+        parent = (pos - 1) / 2;
+        if(s->heap[parent]->count <= e->count) break;
+        heap_set(s,pos,s->heap[parent]);
+        pos = parent;
+    }
+    heap_set(s,pos,e);
+}
+
+static void
+heap_down(struct sketch *s,int pos)
+{
+    struct top_entry *e = s->heap[pos];
+    int child;
+
+    while((child = 2 * pos + 1) < s->used)
+    {
+        if(child + 1 < s->used && s->heap[child + 1]->count < s->heap[child]->count) child++;
+        if(e->count <= s->heap[child]->count) break;
+        heap_set(s,pos,s->heap[child]);
+        pos = child;
+    }
+    heap_set(s,pos,e);
+}
+
+static void
+table_remove(struct sketch *s,struct top_entry *e)
+{
+    struct top_entry **p = &s->table[e->hash & (s->table_size - 1)];
+
+    while(*p != e) p = &(*p)->next;
+    *p = e->next;
+}
+
+/* start monitoring the value of item in entry e */
+static void
+entry_set(struct sketch *s,struct top_entry *e,struct tlvitem *item,unsigned long long h)
+{
+    size_t len;
+
+    if(item->value_length > e->key_size)
+    {
+        e->key_size = item->value_length;
+        e->key = xrealloc(e->key,e->key_size);
+    }
+    memcpy(e->key,item->raw_value,item->value_length);
+    e->key_len = item->value_length;
+    e->hash = h;
+
+    convert_value(item);
+    len = strlen(item->converted_value) + 1;
+    if(len > e->text_size)
+    {
+        e->text_size = len;
+        e->text = xrealloc(e->text,e->text_size);
+    }
+    memcpy(e->text,item->converted_value,len);
+
+    e->next = s->table[h & (s->table_size - 1)];
+    s->table[h & (s->table_size - 1)] = e;
+}
+
+static void
+top_add(struct sketch *s,struct tlvitem *item,unsigned long long h)
+{
+    struct top_entry *e;
+
+    for(e = s->table[h & (s->table_size - 1)];e != NULL;e = e->next)
+    {
+        if(e->hash == h && e->key_len == item->value_length && memcmp(e->key,item->raw_value,e->key_len) == 0)
+        {
+            e->count++;
+            heap_down(s,e->heap_pos);
+            return;
+        }
+    }
+
+    if(s->used < s->k)
+    {
+        e = &s->entries[s->used];
+        e->count = 1;
+        e->error = 0;
+        entry_set(s,e,item,h);
+        heap_set(s,s->used++,e);
+        heap_up(s,e->heap_pos);
+    } else
+    {
+        e = s->heap[0];          // replace the smallest
+        table_remove(s,e);
+        e->error = e->count;
+        e->count++;
+        entry_set(s,e,item,h);
+        heap_down(s,0);
+    }
+}
+
+static void
+distinct_add(struct sketch *s,unsigned long long h)
+{
+    unsigned int j = (unsigned int) (h >> (64 - HLL_PRECISION));
+    unsigned char rank = 1;
+
+    h <<= HLL_PRECISION;
+    while(!(h & 0x8000000000000000ULL) && rank <= 64 - HLL_PRECISION)
+    {
+        rank++;
+        h <<= 1;
+    }
+    if(rank > s->registers[j]) s->registers[j] = rank;
+}
+
+/* element has been parsed */
+void
+sketch_item(struct tlvitem *item)
+{
+    unsigned long long h;
+    unsigned int mask;
+    int i;
+
+    if(item->tlv == NULL || item->tlv_type == T_CONSTRUCTED) return;
+
+    mask = sketches_of[item->tlv->index];
+    if(!mask) return;
+
+    h = value_hash(item->raw_value,item->value_length);
+
+    for(i = 0;mask;i++,mask >>= 1)
+    {
+        if(!(mask & 1)) continue;
+        if(sketches[i].type == S_TOP)
+        {
+            top_add(&sketches[i],item,h);
+        } else
+        {
+            distinct_add(&sketches[i],h);
+        }
+    }
+}
+
+static double
+distinct_estimate(struct sketch *s)
+{
+    double m = (double) HLL_REGISTERS,sum = 0,e;
+    int j,zeros = 0;
+
+    for(j = 0;j < HLL_REGISTERS;j++)
+    {
+        sum += ldexp(1.0,-(int) s->registers[j]);
+        if(!s->registers[j]) zeros++;
+    }
+
+    e = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+    if(e <= 2.5 * m && zeros) e = m * log(m / (double) zeros);     // linear counting for small cardinalities
+    return e;
+}
+
+/* qsort comparison, largest count first */
+static int
+compare_entries(const void *a,const void *b)
+{
+    const struct top_entry *ea = *(const struct top_entry **) a,*eb = *(const struct top_entry **) b;
+
+    return ea->count < eb->count ? 1 : (ea->count > eb->count ? -1 : strcmp(ea->text,eb->text));
+}
+
+/* print the sketches as tab separated lines, file is printed as first column if not NULL */
+static void
+sketch_print(FILE *fp,char *file)
+{
+    struct top_entry **list;
+    struct sketch *s;
+    int i,j;
+
+    for(i = 0;i < sketch_count;i++)
+    {
+        s = &sketches[i];
+        if(s->type == S_TOP)
+        {
+            list = xmalloc(sizeof(struct top_entry *) * (s->used + 1));
+            for(j = 0;j < s->used;j++) list[j] = s->heap[j];
+            qsort(list,(size_t) s->used,sizeof(struct top_entry *),compare_entries);
+            for(j = 0;j < s->used;j++)
+            {
+                if(file != NULL) fprintf(fp,"%s\t",file);
+                fprintf(fp,"top(%s)\t%s\t%lld\t%lld\n",s->name,list[j]->text,(long long) list[j]->count,
+                        (long long) list[j]->error);
+            }
+            free(list);
+        } else
+        {
+            if(file != NULL) fprintf(fp,"%s\t",file);
+            fprintf(fp,"distinct(%s)\t%.0f\n",s->name,distinct_estimate(s));
+        }
+    }
+}
+
+/* input file has been parsed */
+void
+sketch_file_end()
+{
+    int i;
+
+    if(!sketching || !sketch_per_file) return;
+
+    sketch_print(print_list_output(),get_current_file_name());
+    for(i = 0;i < sketch_count;i++) sketch_clear(&sketches[i]);
+}
+
+/* print the sketches of the whole run */
+void
+sketch_report(FILE *fp)
+{
+    if(!sketching || sketch_per_file) return;
+
+    sketch_print(fp,NULL);
+}
@@ -0,0 +1,139 @@
+/* 
+   tlve - A program to parse tag-length-value structures and print them in different formats
+
+   Copyright (C) 2009 Timo Savinen
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation,
+   Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.  
+*/ 
+#include "tlve.h"
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#include <time.h>
+
+/* Runtime statistics, printed to standard error at exit with option --stats.
+
+   Counters are simple increments and they are updated always. Clock is read
+   only when statistics are enabled, so the timing does not cost anything otherwise.
+   Parse time is the total time without the time used in other phases.
+ */
+
+#define STATS_TEXT 0
+#define STATS_JSON 1
+
+TLS struct stats stats;
+TLS int stats_enabled = 0;
+
+static TLS int stats_format = STATS_TEXT;
+
+/* enable statistics, format is "text", "json" or NULL for text */
+void
+stats_enable(char *format)
+{
+    if(format == NULL || strcmp(format,"text") == 0)
+    {
+        stats_format = STATS_TEXT;
+    } else if(strcmp(format,"json") == 0)
+    {
+        stats_format = STATS_JSON;
+    } else
+    {
+        panic("Unknown statistics format",format,NULL);
+    }
+    stats_enabled = 1;
+    stats.total_time = stats_clock();
+}
+
+/* monotonic clock in nanoseconds */
+long long
+stats_clock()
+{
+#ifdef HAVE_CLOCK_GETTIME
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (long long) ts.tv_sec * 1000000000LL + (long long) ts.tv_nsec;
+#else
+    struct timeval tv;
+
+    gettimeofday(&tv,NULL);
+    return (long long) tv.tv_sec * 1000000000LL + (long long) tv.tv_usec * 1000LL;
+#endif
+}
+
+static double
+seconds(long long ns)
+{
+    return (double) ns / 1e9;
+}
+
+/* print the statistics to standard error */
+void
+stats_report()
+{
+    FILE_OFFSET elements = 0;
+    long long parse_time;
+    int i,first = 1;
+
+    if(!stats_enabled) return;
+
+    stats.total_time = stats_clock() - stats.total_time;
+    parse_time = stats.total_time - stats.convert_time - stats.print_time - stats.io_time;
+    if(parse_time < 0) parse_time = 0;
+
+    for(i = FIRST_LEVEL;i <= MAX_LEVEL;i++) elements += stats.elements[i];
+
+    if(stats_format == STATS_JSON)
+    {
+        fprintf(stderr,"{\"bytes_read\":%lld,\"elements\":%lld,\"elements_per_level\":{",
+                (long long) stats.bytes_read,(long long) elements);
+        for(i = FIRST_LEVEL;i <= MAX_LEVEL;i++)
+        {
+            if(!stats.elements[i]) continue;
+            fprintf(stderr,"%s\"%d\":%lld",first ? "" : ",",i,(long long) stats.elements[i]);
+            first = 0;
+        }
+        fprintf(stderr,"},\"tlvdef_hash_hits\":%lld,\"tlvdef_hash_misses\":%lld,"
+                "\"buffer_flushes\":%lld,\"buffer_bytes_moved\":%lld,"
+                "\"iconv_conversions\":%lld,\"output_bytes\":%lld,",
+                (long long) stats.hash_hits,(long long) stats.hash_misses,
+                (long long) stats.flushes,(long long) stats.bytes_moved,
+                (long long) stats.iconv_conversions,(long long) stats.output_bytes);
+        fprintf(stderr,"\"seconds\":{\"total\":%.6f,\"parse\":%.6f,\"convert\":%.6f,\"print\":%.6f,\"io_wait\":%.6f}}\n",
+                seconds(stats.total_time),seconds(parse_time),seconds(stats.convert_time),
+                seconds(stats.print_time),seconds(stats.io_time));
+        return;
+    }
+
+    fprintf(stderr,"%s: statistics\n",program_name);
+    fprintf(stderr,"  bytes read          %14lld\n",(long long) stats.bytes_read);
+    fprintf(stderr,"  elements            %14lld\n",(long long) elements);
+    for(i = FIRST_LEVEL;i <= MAX_LEVEL;i++)
+    {
+        if(stats.elements[i]) fprintf(stderr,"    level %-4d        %14lld\n",i,(long long) stats.elements[i]);
+    }
+    fprintf(stderr,"  tlvdef hash hits    %14lld\n",(long long) stats.hash_hits);
+    fprintf(stderr,"  tlvdef hash misses  %14lld\n",(long long) stats.hash_misses);
+    fprintf(stderr,"  buffer flushes      %14lld\n",(long long) stats.flushes);
+    fprintf(stderr,"  buffer bytes moved  %14lld\n",(long long) stats.bytes_moved);
+    fprintf(stderr,"  iconv conversions   %14lld\n",(long long) stats.iconv_conversions);
+    fprintf(stderr,"  output bytes        %14lld\n",(long long) stats.output_bytes);
+    fprintf(stderr,"  seconds total       %14.3f\n",seconds(stats.total_time));
+    fprintf(stderr,"          parse       %14.3f\n",seconds(parse_time));
+    fprintf(stderr,"          convert     %14.3f\n",seconds(stats.convert_time));
+    fprintf(stderr,"          print       %14.3f\n",seconds(stats.print_time));
+    fprintf(stderr,"          I/O wait    %14.3f\n",seconds(stats.io_time));
+}
@@ -36,22 +36,37 @@
 
 #define TLV_HASH_SIZE 1024
 
-struct tlvlist *tlvhash[TLV_HASH_SIZE];
+static TLS struct tlvlist *tlvhash[TLV_HASH_SIZE];
 
 /* level array */
-static struct level levels[MAX_LEVEL + FIRST_LEVEL];
+static TLS struct level levels[MAX_LEVEL + FIRST_LEVEL];
 
 /* current level index for levels array, starts from 1 to be the same as human count */
-static int current_level;
+static TLS int current_level;
 
 
 /* static item, which will be populated and returned by functions in this file */
-static struct tlvitem new;
+static TLS struct tlvitem new;
+
+/* convert values to visible strings when they are read, cursor converts only on request */
+static TLS int convert_values = 1;
+
+/* early termination, 0 = no limit */
+static TLS FILE_OFFSET max_count = 0;       // selected blocks in each file
+static TLS FILE_OFFSET max_total = 0;       // selected blocks in all files
+static TLS FILE_OFFSET head = 0;            // blocks read from each file
+
+/* resynchronization after errors, option --resync */
+static TLS int resync_level = 0;            // 0 = errors are fatal
+static TLS char **resync_tags = NULL;       // hash set of tags seen in resync level, NULL = empty slot
+static TLS size_t resync_tags_size = 0;
+static TLS size_t resync_tag_count = 0;
+static TLS FILE_OFFSET resync_error;        // offset of the previous error in current file
 
 /* for printing hex dump */
 static char hex_to_ascii_low[]={'0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f'};
 static char hex_to_ascii_cap[]={'0','1','2','3','4','5','6','7','8','9','A','B','C','D','E','F'};
-static char *hex_to_ascii;
+static TLS char *hex_to_ascii;
 
 /* calculate hash for a string 
    hash is between 0...TLV_HASH_SIZE - 1
@@ -78,6 +93,21 @@ get_current_level()
     return current_level;
 }
 
+/* set current level, used when restoring the parser state */
+void
+set_current_level(int level)
+{
+    if(level < FIRST_LEVEL || level >= MAX_LEVEL + FIRST_LEVEL) panic("Invalid level",NULL,NULL);
+    current_level = level;
+}
+
+/* return pointer to level data, used when saving and restoring the parser state */
+struct level *
+get_level(int level)
+{
+    return &levels[level];
+}
+
 static TYPE
 get_level_form()
 { 
@@ -195,14 +225,14 @@ consumed_bo(struct bo *bo, size_t offset)
    assuming that negative numbers are presented in two's complement
  */
 static long long int 
-read_int_be(size_t offset,size_t length,unsigned long int mask,int shift)
+read_int_be(BUFFER *data,size_t length,unsigned long int mask,int shift)
 {
     long long int result = 0;
     int is_negative;
     register BUFFER c,*p;
     size_t i = 0;
 
-    p = buffer_data() + offset;
+    p = data;
 
     is_negative = *p & 0x80;         // check the first bit
 
@@ -238,13 +268,13 @@ read_int_be(size_t offset,size_t length,unsigned long int mask,int shift)
 /* read unsigned big endian int from input data
  */
 static unsigned long long int 
-read_uint_be(size_t offset,size_t length,unsigned long int mask,int shift)
+read_uint_be(BUFFER *data,size_t length,unsigned long int mask,int shift)
 {
     unsigned long long int result = 0;
     register BUFFER c,*p;
     size_t i = 0;
 
-    p = buffer_data() + offset;
+    p = data;
 
     while(i < length)
     {
@@ -265,14 +295,14 @@ read_uint_be(size_t offset,size_t length,unsigned long int mask,int shift)
    assuming that negative numbers are presented in two's complement
  */
 static long long int 
-read_int_le(size_t offset,size_t length,unsigned long int mask,int shift)
+read_int_le(BUFFER *data,size_t length,unsigned long int mask,int shift)
 {
     long long int result = 0;
     int is_negative;
     register BUFFER c,*p;
     size_t i = length;
 
-    p = buffer_data() + offset + length - (size_t) 1;
+    p = data + length - (size_t) 1;
 
     is_negative = *p & 0x80;         // check the MS bit
 
@@ -309,13 +339,13 @@ read_int_le(size_t offset,size_t length,unsigned long int mask,int shift)
 /* read unsigned little endian int from input data
  */
 static unsigned long long int 
-read_uint_le(size_t offset,size_t length,unsigned long int mask,int shift)
+read_uint_le(BUFFER *data,size_t length,unsigned long int mask,int shift)
 {
     unsigned long long int result = 0;
     register BUFFER c,*p;
     size_t i = length;
 
-    p = buffer_data() + offset + length - (size_t) 1;
+    p = data + length - (size_t) 1;
 
     while(i)
     {
@@ -501,16 +531,16 @@ read_tag(struct bo *bo,char *tag,TYPE *type,TYPE *form)
     switch(bo->type)
     {
         case T_INTBE:
-            sprintf(tag,"%lli",read_int_be(bo->offset,length,bo->mask,bo->shift));
+            sprintf(tag,"%lli",read_int_be(buffer_data() + bo->offset,length,bo->mask,bo->shift));
             break;
         case T_UINTBE:
-            sprintf(tag,"%llu",read_uint_be(bo->offset,length,bo->mask,bo->shift));
+            sprintf(tag,"%llu",read_uint_be(buffer_data() + bo->offset,length,bo->mask,bo->shift));
             break;
         case T_INTLE:
-            sprintf(tag,"%lli",read_int_le(bo->offset,length,bo->mask,bo->shift));
+            sprintf(tag,"%lli",read_int_le(buffer_data() + bo->offset,length,bo->mask,bo->shift));
             break;
         case T_UINTLE:
-            sprintf(tag,"%llu",read_uint_le(bo->offset,length,bo->mask,bo->shift));
+            sprintf(tag,"%llu",read_uint_le(buffer_data() + bo->offset,length,bo->mask,bo->shift));
             break;
         case T_STRING:
             memcpy(tag,buffer_data() + bo->offset,length);
@@ -556,16 +586,16 @@ read_type(struct bo *bo,char *type,size_t tag_consumed)
     switch(bo->type)
     {
         case T_INTBE:
-            sprintf(type,"%lli",read_int_be(offset,length,bo->mask,bo->shift));
+            sprintf(type,"%lli",read_int_be(buffer_data() + offset,length,bo->mask,bo->shift));
             break;
         case T_UINTBE:
-            sprintf(type,"%llu",read_uint_be(offset,length,bo->mask,bo->shift));
+            sprintf(type,"%llu",read_uint_be(buffer_data() + offset,length,bo->mask,bo->shift));
             break;
         case T_INTLE:
-            sprintf(type,"%lli",read_int_le(offset,length,bo->mask,bo->shift));
+            sprintf(type,"%lli",read_int_le(buffer_data() + offset,length,bo->mask,bo->shift));
             break;
         case T_UINTLE:
-            sprintf(type,"%llu",read_uint_le(offset,length,bo->mask,bo->shift));
+            sprintf(type,"%llu",read_uint_le(buffer_data() + offset,length,bo->mask,bo->shift));
             break;
         case T_STRING:
             memcpy(type,buffer_data() + offset,length);
@@ -611,11 +641,11 @@ read_length(struct bo *bo,FILE_OFFSET *vlength,size_t tag_consumed)
     {
         case T_INTBE:
         case T_UINTBE:
-            *vlength = (FILE_OFFSET) read_uint_be(offset,length,bo->mask,bo->shift);
+            *vlength = (FILE_OFFSET) read_uint_be(buffer_data() + offset,length,bo->mask,bo->shift);
             break;
         case T_INTLE:
         case T_UINTLE:
-            *vlength = (FILE_OFFSET) read_uint_le(offset,length,bo->mask,bo->shift);
+            *vlength = (FILE_OFFSET) read_uint_le(buffer_data() + offset,length,bo->mask,bo->shift);
             break;
         case T_STRING:
         case T_HEX:
@@ -795,7 +825,7 @@ search_tlvlist(struct tlvlist *list,char *tag,TYPE tag_type)
 }
 
 
-static struct tlvdef *
+struct tlvdef *
 find_tlvdef(char *tag,TYPE tag_type)
 {
     size_t tlv_hash;
@@ -807,10 +837,14 @@ find_tlvdef(char *tag,TYPE tag_type)
 
     if(retval == NULL)
     {
+        stats.hash_misses++;
         if((retval = search_tlvlist(structure.tlv,tag,tag_type)) != NULL)
         {
             add_hash_list(tlv_hash,retval);
         }
+    } else
+    {
+        stats.hash_hits++;
     }
     
     return retval;
@@ -896,7 +930,27 @@ search_type_mapping(char *type,struct type_mappings *types)
     return T_UNKNOWN;
 }
 
+/* convert the value, measure the time if statistics or profiling is enabled */
+static void
+timed_convert_value(struct tlvitem *tlvi)
+{
+    long long start;
+
+    if(!stats_enabled && !profile_enabled)
+    {
+        convert_value(tlvi);
+        return;
+    }
+
+    start = stats_clock();
+    convert_value(tlvi);
+    start = stats_clock() - start;
+    stats.convert_time += start;
+    if(profile_enabled) profile_convert(tlvi,start);
+}
+
 /* read the value part of the tlv triplet, write it to tlvitem->converted_value
+   if value conversion is on.
    return the consumed bytes for the value
  */
 static size_t
@@ -904,9 +958,8 @@ read_value(struct tlvitem *tlvi)
 {
    int term_pos = -1;
    size_t consumed;
-   size_t length,length_needed;
+   size_t length;
    TYPE type;
-   char *format;
 
    if(tlvi->form == T_INDEFINITE)
    {
@@ -925,6 +978,8 @@ read_value(struct tlvitem *tlvi)
        buffer_error("File does not contain enough data to read a value",tlvi);
    }
 
+   tlvi->raw_value = buffer_data();           // buffer may have been flushed
+
 
    if(tlvi->tlv == NULL)
    {
@@ -964,6 +1019,26 @@ read_value(struct tlvitem *tlvi)
 
    }
 
+   tlvi->valuetype = type;
+   tlvi->value_length = length;
+
+   if(convert_values) timed_convert_value(tlvi);
+
+   return consumed;
+}
+
+/* convert the raw value of tlvi to visible string tlvi->converted_value using
+   type tlvi->valuetype. Raw value must be still in the buffer.
+ */
+void
+convert_value(struct tlvitem *tlvi)
+{
+   size_t length = tlvi->value_length;
+   size_t length_needed;
+   TYPE type = tlvi->valuetype;
+   BUFFER *data = tlvi->raw_value;
+   char *format;
+
    /* check how must data should be reserved for converted value */
    switch(type)
    {
@@ -1020,57 +1095,57 @@ read_value(struct tlvitem *tlvi)
         }
     }
 
+    tlvi->int_value = 0;
+
     switch(type)
     {
         case T_INTBE:
-            sprintf(tlvi->converted_value,format,read_int_be(0,length,0,0));
+            tlvi->int_value = read_int_be(data,length,0,0);
+            sprintf(tlvi->converted_value,format,tlvi->int_value);
             break;
         case T_INTLE:
-            sprintf(tlvi->converted_value,format,read_int_le(0,length,0,0));
+            tlvi->int_value = read_int_le(data,length,0,0);
+            sprintf(tlvi->converted_value,format,tlvi->int_value);
             break;
         case T_UINTBE:
-            format_epoch((time_t) read_uint_be(0,length,0,0),format,tlvi->converted_value,tlvi->converted_value_len);
-            if(!*tlvi->converted_value) sprintf(tlvi->converted_value,format,read_uint_be(0,length,0,0));
-            break;
         case T_UINTLE:
-            format_epoch((time_t) read_uint_be(0,length,0,0),format,tlvi->converted_value,tlvi->converted_value_len);
-            if(!*tlvi->converted_value) sprintf(tlvi->converted_value,format,read_uint_be(0,length,0,0));
+            tlvi->int_value = (long long int) read_uint_be(data,length,0,0);
+            format_epoch((time_t) tlvi->int_value,format,tlvi->converted_value,tlvi->converted_value_len);
+            if(!*tlvi->converted_value) sprintf(tlvi->converted_value,format,(unsigned long long int) tlvi->int_value);
             break;
         case T_STRING:
-            memcpy(tlvi->converted_value,buffer_data(),length);
+            memcpy(tlvi->converted_value,data,length);
             tlvi->converted_value[length] = 0;
             break;
         case T_HEX:
-            format_hex_string(tlvi->converted_value,buffer_data(),length);
+            format_hex_string(tlvi->converted_value,data,length);
             break;
         case T_HEXS:
-            format_hexs_string(tlvi->converted_value,buffer_data(),length);
+            format_hexs_string(tlvi->converted_value,data,length);
             break;
         case T_DEC:
-            format_dec_string(tlvi->converted_value,buffer_data(),length);
+            format_dec_string(tlvi->converted_value,data,length);
             break;
         case T_ESCAPED:
         case T_UNKNOWN:
-            format_escaped(tlvi->converted_value,buffer_data(),length);
+            format_escaped(tlvi->converted_value,data,length);
             break;
         case T_BCD:
-            format_bcd_string(tlvi->converted_value,buffer_data(),length);
+            format_bcd_string(tlvi->converted_value,data,length);
             break;
         case T_BCDS:
-            format_bcds_string(tlvi->converted_value,buffer_data(),length);
+            format_bcds_string(tlvi->converted_value,data,length);
             break;
         case T_BITSTRING:
-            format_bit_string(tlvi->converted_value,buffer_data(),length,tlvi->tl->tag->type);
+            format_bit_string(tlvi->converted_value,data,length,tlvi->tl->tag->type);
             break;
         case T_OID:
-            format_oid(tlvi->converted_value,buffer_data(),length);
+            format_oid(tlvi->converted_value,data,length);
             break;
         default:
             tlvi->converted_value[0] = 0;
             break;
     }
-
-    return consumed;
 }
 
 /* read tag-length pair, return the bytes consumed for the pair
@@ -1158,6 +1233,10 @@ maybe_constructed(TYPE tag_type,char *tag,FILE_OFFSET *length)
 struct tlvitem *
 parse_tlv()
 {
+    long long start = 0;
+
+    if(profile_enabled) start = stats_clock();
+
     buffer(B_FLUSH,0);              // try to make sure that there is at least something to read in buffer and this ensures that
                                     // the end of file can be recogniced with buffer_eof, in following steps
     
@@ -1175,9 +1254,13 @@ parse_tlv()
     new.tl = current_tl();
     new.form = new.tl->form;
     new.raw_tl = buffer_data();
+    new.raw_tl_length = 0;
+    new.raw_value_length = 0;
 
     if(!read_tl(&new)) buffer_error("Not a valid tag/length",&new);    // read tl pair 
 
+    stats.elements[new.level]++;
+
     tl_buffer_read(new.raw_tl_length);                         // tl is now read, move pointer to beginning of value part, this is safe
 
     new.raw_value = buffer_data();                 
@@ -1211,6 +1294,8 @@ parse_tlv()
         new.raw_value_length = new.length;                     // constructed data size, do not tl_buffer_read, because this
     }                                                          // contains individual tlv triplets
 
+    if(profile_enabled) profile_element(&new,stats_clock() - start);
+
     return &new;
 }
 
@@ -1248,32 +1333,288 @@ check_premature_eof()
 
 
 
+/* release the hash lists of tlv definitions and the path names */
+void
+execute_free()
+{
+    struct tlvlist *list,*next;
+    int j;
+
+    for(j = 0;j < TLV_HASH_SIZE;j++)
+    {
+        for(list = tlvhash[j];list != NULL;list = next)
+        {
+            next = list->next;
+            free(list);
+        }
+        tlvhash[j] = NULL;
+    }
+    print_init_path();
+}
+
+/* initialize the parser after configuration has been read */
+void
+execute_init()
+{
+    execute_free();
+
+    hex_to_ascii = (structure.hex_caps ? hex_to_ascii_cap : hex_to_ascii_low);
+}
+
+/* stop reading a file after count blocks has been selected */
+void
+set_max_count(FILE_OFFSET count)
+{
+    if(count <= (FILE_OFFSET) 0) panic("Maximum count must be greater than zero",NULL,NULL);
+    max_count = count;
+}
+
+/* stop after count blocks has been selected in all files */
+void
+set_max_total(FILE_OFFSET count)
+{
+    if(count <= (FILE_OFFSET) 0) panic("Maximum count must be greater than zero",NULL,NULL);
+    max_total = count;
+}
+
+/* stop reading a file after count blocks */
+void
+set_head(FILE_OFFSET count)
+{
+    if(count <= (FILE_OFFSET) 0) panic("Head count must be greater than zero",NULL,NULL);
+    head = count;
+}
+
+/* continue after errors, elements are searched in level, 0 = the start level of printing */
+void
+set_resync(int level)
+{
+    if(level < 0) panic("Resync level must be zero or greater",NULL,NULL);
+    resync_level = level ? level : print_list_block_level();
+}
+
+/* FNV-1a of tag */
+static size_t
+tag_hash(char *tag)
+{
+    size_t h = (size_t) 2166136261U;
+
+    while(*tag) h = (h ^ (unsigned char) *tag++) * (size_t) 16777619U;
+    return h;
+}
+
+/* return the slot of tag in resync tag set, an empty slot if tag is not in set */
+static char **
+resync_find_tag(char *tag)
+{
+    size_t i = tag_hash(tag) & (resync_tags_size - 1);
+
+    while(resync_tags[i] != NULL && strcmp(resync_tags[i],tag) != 0) i = (i + 1) & (resync_tags_size - 1);
+    return &resync_tags[i];
+}
+
+/* remember the tags seen in resync level */
+static void
+resync_add_tag(char *tag)
+{
+    char **slot,**old;
+    size_t old_size,i;
+
+    slot = resync_find_tag(tag);
+    if(*slot != NULL) return;
+    *slot = xstrdup(tag);
+
+    if(2 * ++resync_tag_count > resync_tags_size)
+    {
+        old = resync_tags;
+        old_size = resync_tags_size;
+        resync_tags_size *= 2;
+        resync_tags = xcalloc(resync_tags_size,sizeof(char *));
+        for(i = 0;i < old_size;i++) if(old[i] != NULL) *resync_find_tag(old[i]) = old[i];
+        free(old);
+    }
+}
+
+/* forget the tags of the previous file */
+static void
+resync_clear_tags()
+{
+    size_t i;
+
+    if(resync_tags == NULL)
+    {
+        resync_tags_size = 64;
+        resync_tags = xcalloc(resync_tags_size,sizeof(char *));
+    }
+
+    for(i = 0;i < resync_tags_size;i++)
+    {
+        free(resync_tags[i]);
+        resync_tags[i] = NULL;
+    }
+    resync_tag_count = 0;
+}
+
+/* check if an element in current level could start at current position of buffer */
+static int
+resync_candidate()
+{
+    struct tlvitem c;
+
+    c.level = current_level;
+    c.tlv_type = T_UNKNOWN;
+    c.tag[0] = 0;
+    c.type[0] = 0;
+    c.length = 0;
+    c.tl = current_tl();
+    c.form = c.tl->form;
+    c.raw_tl = buffer_data();
+
+    if(!read_tl(&c)) return 0;
+
+    if(levels[current_level].form == T_DEFINITE && c.form != T_INDEFINITE &&
+       (FILE_OFFSET) c.raw_tl_length + c.length > levels[current_level].size) return 0;    // does not fit to parent
+
+    if(!resync_tag_count || current_level != resync_level) return find_tlvdef(c.tag,c.tl->tag->type) != NULL;
+
+    return *resync_find_tag(c.tag) != NULL;
+}
+
+/* leave the current level, printing and print path follow the levels as in execute() */
+static void
+resync_level_up(int printing)
+{
+    level_up();
+    if(aggregating)
+    {
+        aggregate_level(get_current_level());
+    } else if(printing)
+    {
+        print_list_print();
+    }
+    print_list_up();
+}
+
+/* Resynchronize after an error. Levels deeper than the resync level are dropped and
+   input is skipped octet by octet until an element which was already seen in the resync level
+   is found, and its length fits to the space left in the parent element. If the parent element ends
+   processing continues after it.
+   Return 0 if the rest of the file must be skipped
+ */
+static int
+resync(int printing)
+{
+    FILE_OFFSET start,error;
+
+    start = file_offset();
+    error = buffer_error_offset();
+    if(error < (FILE_OFFSET) 0 || error > start) error = start;
+
+    fprintf(stderr,"%s: %s\n",program_name,panic_message());
+
+    while(print_list_path_level() > current_level - FIRST_LEVEL) print_list_up();   // constructor whose level was not entered
+    print_list_drop();
+
+    if(error == resync_error || buffer_eof())      // no progress since last error or nothing left
+    {
+        fprintf(stderr,"%s: skipping the rest of file '%s'\n",program_name,get_current_file_name());
+        while(current_level > FIRST_LEVEL) resync_level_up(printing);     // close the open elements
+        return 0;
+    }
+    resync_error = error;
+
+    while(current_level > resync_level) resync_level_up(printing);
+
+    for(;;)
+    {
+        buffer(B_FLUSH,0);
+        if(buffer_eof()) break;
+        if(levels[current_level].form == T_DEFINITE && current_level > FIRST_LEVEL && levels[current_level].size <= (FILE_OFFSET) 0) break;
+        if(resync_candidate()) break;
+        tl_buffer_read(1);
+    }
+
+    fprintf(stderr,"%s: skipped octets %lld-%lld in file '%s'\n",program_name,(long long) error,(long long) file_offset(),
+            get_current_file_name());
+
+    while(level_current_size() <= 0 && get_level_form() == T_DEFINITE) resync_level_up(printing);
+    return 1;
+}
+
 /* main execution loop */
 void
 execute()
 {
     struct tlvitem *i;
-    int pl_up,j;
+    int pl_up;
+    int resumed;
+    int printing;
+    volatile int stop = 0;          // 1 = stop reading current file, 2 = stop reading all files
+    volatile int skip;              // rest of the file is skipped after an error
+    int block_level = print_list_block_level();
+    volatile FILE_OFFSET file_selected,blocks;
+    jmp_buf env;
 
-    for(j = 0;j < TLV_HASH_SIZE;j++) tlvhash[j] = NULL;
+    execute_init();
 
-    print_init_path();
-     
-    hex_to_ascii = (structure.hex_caps ? hex_to_ascii_cap : hex_to_ascii_low);
+    printing = !profile_tree && !aggregating && !sketching;
+    convert_values = printing;   // otherwise values are not printed, aggregation and sketches convert the values they need
 
     while(open_next_input_file())
     {
         print_list_clear_hold();
         init_level();
+        resumed = checkpoint_restore();
         buffer(B_INIT,0);
-        print_file_header();
-        while((i = parse_tlv()) != NULL)
+        raw_file_start();
+        print_list_file_output();
+        if(!resumed && printing && !raw_output) print_file_header();
+        file_selected = print_list_selected();
+        blocks = 0;
+        skip = 0;
+        if(resync_level)
+        {
+            resync_clear_tags();
+            resync_error = (FILE_OFFSET) -1;
+            if(setjmp(env))
+            {
+                data_error_catch(NULL);
+                skip = !resync(printing);
+            }
+            data_error_catch(&env);
+        }
+        while(!skip && (i = parse_tlv()) != NULL)
         {
             pl_up = 0;
 
+            if(i->level == resync_level && i->tlv_type != T_EOC) resync_add_tag(i->tag);
+
+            if(head && i->level == block_level && i->tlv_type != T_EOC && ++blocks > head)
+            {
+                stop = 1;
+                break;
+            }
+
+            if(raw_output) raw_item(i);
+
             if(i->tlv_type == T_CONSTRUCTED) print_list_down(i);
 
-            if(i->tlv_type != T_EOC) print_list_add_item(i);
+            if(i->tlv_type != T_EOC)
+            {
+                if(profile_tree)
+                {
+                    profile_tree_add(i);
+                } else if(aggregating)
+                {
+                    aggregate_item(i);
+                } else if(sketching)
+                {
+                    sketch_item(i);
+                } else
+                {
+                    STATS_TIME(print_time,print_list_add_item(i));
+                }
+            }
 
             switch(i->tlv_type)
             {
@@ -1297,11 +1638,400 @@ execute()
                 pl_up++;
             }
 
-            print_list_print();
+            if(aggregating)
+            {
+                aggregate_level(get_current_level());
+            } else if(printing)
+            {
+                STATS_TIME(print_time,print_list_print());
+            }
 
             while(pl_up--) print_list_up();
+
+            checkpoint_check();
+
+            if(progress_requested) progress_report();
+
+            if(max_total && print_list_selected() >= max_total)
+            {
+                stop = 2;
+                break;
+            }
+            if(max_count && print_list_selected() - file_selected >= max_count)
+            {
+                stop = 1;
+                break;
+            }
+        }
+        if(stop || skip)
+        {
+            print_list_reset();
+        } else
+        {
+            check_premature_eof();
+        }
+        if(resync_level) data_error_catch(NULL);
+        if(raw_output) raw_flush();
+        if(printing && !raw_output) print_file_trailer();
+        sketch_file_end();
+        if(stop == 2)
+        {
+            clear_input_files();
+            break;
+        }
+        stop = 0;
+    }
+    checkpoint_done();
+}
+
+/* Validation loop, option --validate. Elements are parsed and the level structure
+   is checked without converting or printing the values. An error does not stop
+   the processing, it is reported and the validation continues with the next file.
+   One tab separated line is written to report for each file:
+   name, ok or error, count of elements, offset of error or size of file, error message.
+   Return the count of invalid files
+ */
+int
+execute_validate(FILE *report)
+{
+    struct tlvitem *i;
+    jmp_buf env;
+    volatile FILE_OFFSET elements;
+    volatile int invalid = 0;
+    FILE_OFFSET offset;
+
+    execute_init();
+
+    convert_values = 0;
+
+    for(;;)
+    {
+        elements = 0;
+        buffer_error_offset();
+
+        if(setjmp(env))
+        {
+            data_error_catch(NULL);
+            offset = buffer_error_offset();
+            if(offset < (FILE_OFFSET) 0) offset = file_offset();
+            fprintf(report,"%s\terror\t%lld\t%lld\t%s\n",get_current_file_name(),(long long) elements,
+                    (long long) offset,panic_message());
+            invalid++;
+            continue;
+        }
+        data_error_catch(&env);
+
+        if(!open_next_input_file())     // a file which cannot be opened is reported as invalid
+        {
+            data_error_catch(NULL);
+            break;
+        }
+
+        init_level();
+        buffer(B_INIT,0);
+        while((i = parse_tlv()) != NULL)
+        {
+            elements++;
+
+            switch(i->tlv_type)
+            {
+                case T_CONSTRUCTED:
+                    level_down(i->length,i->tlv,i->form);
+                    break;
+                case T_EOC:
+                    if(get_level_form() == T_INDEFINITE) level_up();
+                    break;
+                default:
+                    break;
+            }
+
+            while(level_current_size() <= 0 && get_level_form() == T_DEFINITE) level_up();
+
+            if(progress_requested) progress_report();
+        }
+        check_premature_eof();
+
+        data_error_catch(NULL);
+        fprintf(report,"%s\tok\t%lld\t%lld\t\n",get_current_file_name(),(long long) elements,(long long) file_offset());
+    }
+    return invalid;
+}
+
+/* skip size bytes of current level */
+static void
+skip_data(FILE_OFFSET size)
+{
+    if(buffer_skip(size) < size) buffer_error("File does not contain enough data to skip an element",NULL);
+    update_levels((size_t) size);
+}
+
+/* split loop, option --split. Blocks are written to chunks by raw_split_block.
+   Only the tag/length headers are read: constructed blocks with definite length are
+   skipped without parsing their contents, values are not converted
+ */
+void
+execute_split()
+{
+    struct tlvitem *i;
+    int block_level = print_list_block_level();
+    FILE_OFFSET start = (FILE_OFFSET) -1;    // start of the indefinite block being read
+
+    execute_init();
+
+    convert_values = 0;
+
+    while(open_next_input_file())
+    {
+        init_level();
+        buffer(B_INIT,0);
+        raw_file_start();
+        while((i = parse_tlv()) != NULL)
+        {
+            if(i->level == block_level && i->tlv_type != T_EOC)
+            {
+                if(i->tlv_type != T_CONSTRUCTED)
+                {
+                    raw_split_block(i->file_offset);
+                } else if(i->form == T_DEFINITE)
+                {
+                    if(!enough_size(i->length)) buffer_error("Constructed element is larger than space left in parent element",i);
+                    skip_data(i->length);
+                    raw_split_block(i->file_offset);
+                } else
+                {
+                    start = i->file_offset;
+                    level_down(i->length,i->tlv,i->form);
+                }
+            } else
+            {
+                switch(i->tlv_type)
+                {
+                    case T_CONSTRUCTED:
+                        level_down(i->length,i->tlv,i->form);
+                        break;
+                    case T_EOC:
+                        if(get_level_form() == T_INDEFINITE) level_up();
+                        break;
+                    default:
+                        break;
+                }
+            }
+
+            while(level_current_size() <= 0 && get_level_form() == T_DEFINITE) level_up();
+
+            /* block ends when its end-of-content is read, definite parents may end at the same time */
+            if(start >= (FILE_OFFSET) 0 && current_level <= block_level)
+            {
+                raw_split_block(start);
+                start = (FILE_OFFSET) -1;
+            }
+
+            if(progress_requested) progress_report();
         }
         check_premature_eof();
-        print_file_trailer();
+        raw_flush();
     }
+    raw_split_end();
+}
+
+/* execution loop for the library, elements are given to handler functions instead of printing.
+   execute_init must be called before this.
+   Return 1 if a handler function stopped the parsing, 0 if all input was parsed
+ */
+int
+execute_handler(struct handler *h)
+{
+    struct tlvitem *i;
+    int pl_up;
+    int stop = 0;
+
+    convert_values = 1;
+
+    while(!stop && open_next_input_file())
+    {
+        init_level();
+        while(print_list_path_level()) print_list_up();
+        if(!buffer(B_INIT,0)) continue;
+        while(!stop && (i = parse_tlv()) != NULL)
+        {
+            pl_up = 0;
+
+            switch(i->tlv_type)
+            {
+                case T_CONSTRUCTED:
+                    print_list_down(i);
+                    if(h->level_enter != NULL) stop = h->level_enter(i,h->data);
+                    level_down(i->length,i->tlv,i->form);
+                    break;
+                case T_EOC:
+                    if(get_level_form() == T_INDEFINITE)
+                    {
+                        level_up();
+                        pl_up = 1;
+                    }
+                    break;
+                default:
+                    if(h->element != NULL) stop = h->element(i,h->data);
+                    break;
+            }
+
+            while(level_current_size() <= 0 && get_level_form() == T_DEFINITE) 
+            {
+                level_up();
+                pl_up++;
+            }
+
+            while(pl_up--)
+            {
+                print_list_up();
+                if(h->level_exit != NULL && !stop) stop = h->level_exit(current_level + pl_up,h->data);
+            }
+        }
+        if(!stop) check_premature_eof();
+    }
+    return stop;
+}
+
+/* return the integer value of an element in *value, return 0 if the value is not an integer */
+int
+item_int_value(struct tlvitem *tlvi,long long int *value)
+{
+    switch(tlvi->valuetype)
+    {
+        case T_INTBE:
+            *value = read_int_be(tlvi->raw_value,tlvi->value_length,0,0);
+            break;
+        case T_INTLE:
+            *value = read_int_le(tlvi->raw_value,tlvi->value_length,0,0);
+            break;
+        case T_UINTBE:
+            *value = (long long int) read_uint_be(tlvi->raw_value,tlvi->value_length,0,0);
+            break;
+        case T_UINTLE:
+            *value = (long long int) read_uint_le(tlvi->raw_value,tlvi->value_length,0,0);
+            break;
+        default:
+            return 0;
+    }
+    return 1;
+}
+
+/* Cursor, elements are read one by one by the caller. Only the elements asked are read,
+   constructed elements which are not entered are skipped without parsing their content
+   if the length is known. Values are not converted when read, see convert_value.
+ */
+
+static TLS struct tlvitem *cursor_item;   // last element returned by cursor_next, NULL if none
+static TLS int cursor_level_end;           // end-of-content of current indefinite level has been read
+static TLS int cursor_eof;                 // no data in input
+
+/* start reading the next input file using cursor, return 0 if there is no file or data */
+int
+cursor_start()
+{
+    convert_values = 0;
+    cursor_item = NULL;
+    cursor_level_end = 0;
+    cursor_eof = 1;
+
+    if(!open_next_input_file()) return 0;
+
+    init_level();
+    while(print_list_path_level()) print_list_up();
+    cursor_eof = !buffer(B_INIT,0);
+    return !cursor_eof;
+}
+
+/* is the current level read */
+static int
+cursor_level_done()
+{
+    if(cursor_eof || cursor_level_end) return 1;
+    return current_level > FIRST_LEVEL && get_level_form() == T_DEFINITE && level_current_size() <= 0;
+}
+
+/* skip the constructed element returned last */
+static void
+cursor_skip_item()
+{
+    FILE_OFFSET length = cursor_item->length;
+
+    if(cursor_item->form == T_DEFINITE)
+    {
+        if(!enough_size(length)) buffer_error("Constructed element is larger than space left in parent element",cursor_item);
+        cursor_item = NULL;
+        skip_data(length);
+    } else
+    {
+        cursor_enter();
+        cursor_leave();
+    }
+}
+
+/* return the next element in current level, NULL if the level or the input has ended.
+   If last element was constructed and it was not entered, it is skipped first
+ */
+struct tlvitem *
+cursor_next()
+{
+    struct tlvitem *i;
+
+    if(cursor_item != NULL && cursor_item->tlv_type == T_CONSTRUCTED) cursor_skip_item();
+    cursor_item = NULL;
+
+    while(!cursor_level_done())
+    {
+        i = parse_tlv();
+        if(i == NULL)
+        {
+            cursor_eof = 1;
+            check_premature_eof();
+            return NULL;
+        }
+        if(i->tlv_type == T_EOC)
+        {
+            if(get_level_form() == T_INDEFINITE) cursor_level_end = 1;
+            continue;
+        }
+        cursor_item = i;
+        return i;
+    }
+    return NULL;
+}
+
+/* go into the constructed element returned last, return 0 if it was not constructed */
+int
+cursor_enter()
+{
+    if(cursor_item == NULL || cursor_item->tlv_type != T_CONSTRUCTED) return 0;
+
+    print_list_down(cursor_item);
+    level_down(cursor_item->length,cursor_item->tlv,cursor_item->form);
+    cursor_item = NULL;
+    cursor_level_end = 0;
+    return 1;
+}
+
+/* skip the rest of the current level and continue in parent level, return 0 in first level.
+   Rest of definite level is skipped without parsing.
+ */
+int
+cursor_leave()
+{
+    if(current_level == FIRST_LEVEL) return 0;
+
+    if(get_level_form() == T_DEFINITE && !cursor_eof)
+    {
+        cursor_item = NULL;
+        if(level_current_size() > (FILE_OFFSET) 0) skip_data(level_current_size());
+    } else
+    {
+        while(cursor_next() != NULL);
+    }
+
+    cursor_item = NULL;
+    cursor_level_end = 0;
+    level_up();
+    print_list_up();
+    return 1;
 }
@@ -37,12 +37,6 @@
 #endif
 
 
-#ifdef PACKAGE
-char *program_name = PACKAGE;
-#else
-char *program_name = "tlve";
-#endif
-
 #ifdef PACKAGE_VERSION
 char *version = PACKAGE_VERSION;
 #else
@@ -71,20 +65,37 @@ char *email_address = "tjsa@iki.fi";
 #define EXIT_FAILURE 1
 #define EXIT_SUCCESS 0
 
-/* Global data */
-
-struct structure structure;
-struct tldef *tl = NULL;
-struct print *print = NULL;
-struct hold *hold = NULL;
-struct type_mappings *type_maps = NULL;
-char *codeset = "";           // current code set
-int debug = 0;                // write debug data in case of processing error
-char *tlve_open = NULL;
-
 static void usage (int status);
 
-static char short_opts[] = "o:hVc:dn:s:e:ap:l:L:";
+static char short_opts[] = "o:hVc:dn:s:e:E:ap:l:L:m:";
+
+/* codes for options having only the long form */
+#define OPT_CHECKPOINT 256
+#define OPT_CHECKPOINT_INTERVAL 257
+#define OPT_RESUME 258
+#define OPT_NO_DECOMPRESS 259
+#define OPT_PREPROCESSORS 260
+#define OPT_NO_READ_AHEAD 261
+#define OPT_BATCH_FILES 262
+#define OPT_STATS 263
+#define OPT_PROGRESS 264
+#define OPT_PROFILE_DEFS 265
+#define OPT_PROFILE_TREE 266
+#define OPT_RECORD 267
+#define OPT_GROUP_BY 268
+#define OPT_AGGREGATE 269
+#define OPT_TOP 270
+#define OPT_DISTINCT 271
+#define OPT_SKETCH_PER_FILE 272
+#define OPT_MAX_TOTAL 273
+#define OPT_HEAD 274
+#define OPT_VALIDATE 275
+#define OPT_RESYNC 276
+#define OPT_RAW 277
+#define OPT_SPLIT 278
+#define OPT_SPLIT_RECORDS 279
+#define OPT_QUERIES 280
+#define OPT_SHARD 281
 
 #ifdef HAVE_GETOPT_LONG
 static struct option long_opts[] =
@@ -97,10 +108,38 @@ static struct option long_opts[] =
   {"name-list", 1, 0, 'n'},
   {"structure", 1, 0, 's'},
   {"expression", 1, 0, 'e'},
+  {"expression-file", 1, 0, 'E'},
   {"and", 0, 0, 'a'},
   {"print", 1, 0, 'p'},
   {"start-level", 1, 0, 'l'},
   {"stop-level", 1, 0, 'L'},
+  {"max-count", 1, 0, 'm'},
+  {"max-total", 1, 0, OPT_MAX_TOTAL},
+  {"head", 1, 0, OPT_HEAD},
+  {"validate", 0, 0, OPT_VALIDATE},
+  {"resync", 2, 0, OPT_RESYNC},
+  {"raw", 0, 0, OPT_RAW},
+  {"split", 1, 0, OPT_SPLIT},
+  {"split-records", 1, 0, OPT_SPLIT_RECORDS},
+  {"queries", 1, 0, OPT_QUERIES},
+  {"shard", 1, 0, OPT_SHARD},
+  {"checkpoint", 1, 0, OPT_CHECKPOINT},
+  {"checkpoint-interval", 1, 0, OPT_CHECKPOINT_INTERVAL},
+  {"resume", 0, 0, OPT_RESUME},
+  {"no-decompress", 0, 0, OPT_NO_DECOMPRESS},
+  {"preprocessors", 1, 0, OPT_PREPROCESSORS},
+  {"no-read-ahead", 0, 0, OPT_NO_READ_AHEAD},
+  {"batch-files", 1, 0, OPT_BATCH_FILES},
+  {"stats", 2, 0, OPT_STATS},
+  {"progress", 1, 0, OPT_PROGRESS},
+  {"profile-defs", 0, 0, OPT_PROFILE_DEFS},
+  {"profile-tree", 0, 0, OPT_PROFILE_TREE},
+  {"record", 1, 0, OPT_RECORD},
+  {"group-by", 1, 0, OPT_GROUP_BY},
+  {"aggregate", 1, 0, OPT_AGGREGATE},
+  {"top", 1, 0, OPT_TOP},
+  {"distinct", 1, 0, OPT_DISTINCT},
+  {"sketch-per-file", 0, 0, OPT_SKETCH_PER_FILE},
   {NULL, 0, NULL, 0}
 };
 #endif
@@ -108,28 +147,6 @@ static struct option long_opts[] =
 static void
 usage (int);
 
-void
-panic(char *msg,char *info,char *syserror)
-{
-    if(msg != NULL)
-    {
-        if (info == NULL && syserror == NULL)
-        {
-            fprintf(stderr,"%s: %s\n",program_name,msg);
-        } else if(info != NULL && syserror == NULL)
-        {
-            fprintf(stderr,"%s: %s: %s\n",program_name,msg,info);
-        } else if(info != NULL && syserror != NULL)
-        {
-            fprintf(stderr,"%s: %s: %s; %s\n",program_name,msg,info,syserror);
-        } else if(info == NULL && syserror != NULL)
-        {
-            fprintf(stderr,"%s: %s; %s\n",program_name,msg,syserror);
-        }
-    }
-    exit(EXIT_FAILURE);
-}
-
 char *
 get_default_rc_name()
 {
@@ -180,6 +197,13 @@ main (int argc, char **argv)
     char *config_to_use = NULL;
     char *output_to_use = NULL;
     char *structure_to_use = NULL;
+    int resume = 0;
+    int validate = 0;
+    int resync = -1;
+    int raw = 0;
+    char *queries_to_use = NULL;
+    char *shard_to_use = NULL;
+    int invalid = 0;
 
 #ifdef HAVE_SIGACTION
 #ifndef SA_NOCLDWAIT
@@ -225,12 +249,15 @@ main (int argc, char **argv)
                 }
                 break;
             case 'p':
-                if(print_to_use == NULL)
+                if(strchr(optarg,':') != NULL)
+                {
+                    print_list_add_output(optarg);
+                } else if(print_to_use == NULL)
                 {
                     print_to_use = xstrdup(optarg);
                 } else
                 {
-                    panic("Only one -p option allowed",NULL,NULL);
+                    panic("Only one -p option without output allowed",NULL,NULL);
                 }
                 break;
             case 'o':
@@ -248,6 +275,9 @@ main (int argc, char **argv)
             case 'e':
                 print_list_add_expression(optarg);
                 break;
+            case 'E':
+                print_list_add_key_expression(optarg);
+                break;
             case 'a':
                 expression_and = 1;
                 break;
@@ -260,6 +290,87 @@ main (int argc, char **argv)
             case 'L':
                 print_set_print_stop_level(atoi(optarg));
                 break;
+            case OPT_CHECKPOINT:
+                checkpoint_set_file(optarg);
+                break;
+            case OPT_CHECKPOINT_INTERVAL:
+                checkpoint_set_interval(parse_size(optarg));
+                break;
+            case OPT_RESUME:
+                resume = 1;
+                break;
+            case OPT_NO_DECOMPRESS:
+                set_decompression(0);
+                break;
+            case OPT_PREPROCESSORS:
+                set_preprocessors(atoi(optarg));
+                break;
+            case OPT_NO_READ_AHEAD:
+                set_read_ahead(0);
+                break;
+            case OPT_BATCH_FILES:
+                set_batch_files(atoi(optarg));
+                break;
+            case OPT_STATS:
+                stats_enable(optarg);
+                break;
+            case OPT_PROGRESS:
+                progress_set_interval(atoi(optarg));
+                break;
+            case OPT_PROFILE_DEFS:
+                profile_defs_enable();
+                break;
+            case OPT_PROFILE_TREE:
+                profile_tree_enable();
+                break;
+            case OPT_RECORD:
+                aggregate_set_record(optarg);
+                break;
+            case OPT_GROUP_BY:
+                aggregate_set_keys(optarg);
+                break;
+            case OPT_AGGREGATE:
+                aggregate_set_functions(optarg);
+                break;
+            case OPT_TOP:
+                sketch_add_top(optarg);
+                break;
+            case OPT_DISTINCT:
+                sketch_add_distinct(optarg);
+                break;
+            case OPT_SKETCH_PER_FILE:
+                sketch_set_per_file();
+                break;
+            case 'm':
+                set_max_count((FILE_OFFSET) strtoll(optarg,NULL,10));
+                break;
+            case OPT_MAX_TOTAL:
+                set_max_total((FILE_OFFSET) strtoll(optarg,NULL,10));
+                break;
+            case OPT_HEAD:
+                set_head((FILE_OFFSET) strtoll(optarg,NULL,10));
+                break;
+            case OPT_VALIDATE:
+                validate = 1;
+                break;
+            case OPT_RESYNC:
+                resync = optarg != NULL ? atoi(optarg) : 0;
+                break;
+            case OPT_RAW:
+                raw = 1;
+                break;
+            case OPT_SPLIT:
+                raw_set_split_size(parse_size(optarg));
+                break;
+            case OPT_SPLIT_RECORDS:
+                raw_set_split_records((FILE_OFFSET) strtoll(optarg,NULL,10));
+                break;
+            case OPT_QUERIES:
+                queries_to_use = xstrdup(optarg);
+                break;
+            case OPT_SHARD:
+                shard_to_use = xstrdup(optarg);
+                break;
             case '?':
                 usage(EXIT_SUCCESS);
                 break;
@@ -288,16 +399,70 @@ main (int argc, char **argv)
 
     parse_rc(config_to_use,structure_to_use,print_to_use);
 
+    if(raw) raw_enable();
+
+    if(shard_to_use != NULL) print_list_set_shard(shard_to_use);
+
     print_list_check_names();
 
+    if(queries_to_use != NULL)
+    {
+        if(raw || splitting || resume) panic("Queries cannot be used with --raw, --split or --resume",NULL,NULL);
+        query_load(queries_to_use);
+    }
+
+    if(resync >= 0) set_resync(resync);
+
+    profile_init();
+
+    aggregate_init();
+
+    sketch_init();
+
     if(output_to_use == NULL) output_to_use = "-";
-    print_list_open_output(output_to_use);
+    if(print_list_is_template(output_to_use) && (splitting || validate || resume))
+    {
+        panic("Output name with %f or --shard cannot be used with --split, --validate or --resume",NULL,NULL);
+    }
+    if(splitting)
+    {
+        raw_split_start(output_to_use);
+        print_list_open_output("-");
+    } else if(resume)
+    {
+        print_list_open_output_at(output_to_use,checkpoint_load());
+    } else
+    {
+        print_list_open_output(output_to_use);
+    }
+    print_list_open_outputs(resume);
+
+    progress_start();
+
+    if(validate)
+    {
+        invalid = execute_validate(print_list_output());
+    } else if(splitting)
+    {
+        execute_split();
+    } else
+    {
+        execute();
+    }
 
-    execute();
+    profile_tree_report(print_list_output());
+
+    aggregate_report(print_list_output());
+
+    sketch_report(print_list_output());
 
     print_list_close_output();
 
-    exit (EXIT_SUCCESS);
+    stats_report();
+
+    profile_report();
+
+    exit (invalid ? EXIT_FAILURE : EXIT_SUCCESS);
 }
 
 
@@ -314,11 +479,52 @@ Options:\n\
   -n, --name-list LIST        print only elements having name or tag in comma separated list LIST\n\
   -s, --structure NAME        use structure NAME to process the input data\n\
   -e, --expression NAME=VALUE print only elements for which the expression NAME=VALUE evaluates true\n\
+  -E, --expression-file NAME=FILE\n\
+                              as -e, but true when value of NAME is one of the lines in FILE\n\
+                              (line ending with * is a prefix)\n\
   -a, --and                   all expressions must evaluate true\n\
   -p, --print NAME            use printing definition NAME to print the data\n\
-  -o, --output NAME           send output to NAME instead of standard output\n\
+  -p, --print NAME:OUTPUT     print also to file OUTPUT using printing definition NAME,\n\
+                              can be given several times\n\
+  -o, --output NAME           send output to NAME instead of standard output, %%f in NAME\n\
+                              is replaced by the input file name, one output for each file\n\
   -l, --start-level LEVEL     first level in element hierarchy to be printed\n\
   -L, --stopt-level LEVEL     last level in element hierarchy to be printed\n\
+  -m, --max-count COUNT       stop reading a file after COUNT blocks have been printed\n\
+      --max-total COUNT       stop after COUNT blocks have been printed from all files\n\
+      --head COUNT            read only the first COUNT blocks of each file\n\
+      --validate              only check the structure of input files, print one line for each file\n\
+                              and continue after an invalid file\n\
+      --resync[=LEVEL]        after an error skip to the next element in LEVEL (default start level)\n\
+                              and continue\n\
+      --raw                   write the selected blocks as they are in the input\n\
+      --split SIZE            copy the blocks to files NAME.1, NAME.2, ... of at most SIZE octets\n\
+                              (K, M and G suffixes allowed), NAME is the output file\n\
+      --split-records COUNT   as --split, but at most COUNT blocks in each file\n\
+      --queries FILE          evaluate the queries in FILE in one pass, one query in each line\n\
+                              given with options -n, -e, -E, -a, -l, -L, -p and -o\n\
+      --shard NAME:COUNT      write each block to one of COUNT outputs by the hash of the value of\n\
+                              element NAME, outputs are OUTPUT.0, OUTPUT.1, ... or %%n in OUTPUT\n\
+                              is replaced by the shard number\n\
+      --checkpoint NAME       save processing state periodically to file NAME\n\
+      --checkpoint-interval SIZE\n\
+                              save state after every SIZE bytes of input (K, M and G suffixes allowed)\n\
+      --resume                continue processing from the state saved in checkpoint file\n\
+      --no-decompress         do not decompress gzip, bzip2 or zstd compressed input files\n\
+      --preprocessors COUNT   run input preprocessor (TLVEOPEN) for COUNT files in parallel\n\
+      --no-read-ahead         do not read input in separate thread\n\
+      --batch-files COUNT     read up to COUNT small input files at once (max 64, 0 disables)\n\
+      --stats[=FORMAT]        print statistics to standard error at exit, FORMAT is text or json\n\
+      --progress SECONDS      report progress to standard error every SECONDS seconds (also on SIGUSR1)\n\
+      --profile-defs          print time and octets used by each tlv and printing definition at exit\n\
+      --profile-tree          print only a summary of the tag hierarchy found in input\n\
+      --record NAME           aggregate elements of records NAME instead of printing them\n\
+      --group-by LIST         group the records by values of comma separated element names in LIST\n\
+      --aggregate LIST        print aggregates in LIST for each group: count, sum(NAME), min(NAME),\n\
+                              max(NAME) and count(NAME) (default count)\n\
+      --top NAME[:K]          print approximately K (default 100) most frequent values of element NAME\n\
+      --distinct NAME         print approximate count of distinct values of element NAME\n\
+      --sketch-per-file       print --top and --distinct results after each input file\n\
   -h, --help                  display this help and exit\n\
   -V, --version               output version information and exit\n\
 \nAll remaining arguments are names of input files;\n\
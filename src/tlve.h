@@ -40,6 +40,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
 #ifdef HAVE_INTTYPES_H
 #include <inttypes.h>
 #endif
@@ -57,6 +61,11 @@
 #endif
 
 #include <stdio.h>
+#include <setjmp.h>
+
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#endif
 
 #if defined(__MINGW32__)
 #ifndef WIN32
@@ -76,6 +85,13 @@
 #define atoll atol
 #endif
 
+/* parser state is kept per thread, so that the library can be used in several threads */
+#ifdef HAVE_TLS
+#define TLS __thread
+#else
+#define TLS
+#endif
+
 #if defined(HAVE_REGEX) && !defined(HAVE_REGCOMP)
 #undef HAVE_REGEX
 #endif
@@ -179,6 +195,7 @@ struct print
     char *indent;           // string to be used when indenting
     char *encoding;         // which encoding to use in printing when data encoding is known
     char separator;         // character to be printed after every conted in level, except the last
+    int index;              // index of the definition, used in profiling
     struct print *next;
 };
 
@@ -230,6 +247,7 @@ struct tlvdef
     char *format;           // Printf format to print this data
     int length_adjust;      // adjustment for length when reading the value
     struct hold *hold_buffer; // place to store data for later use.
+    int index;              // index of the definition in structure, used in profiling
 };
 
 /* list for seaarching tlvedef, used also in bash table */
@@ -259,6 +277,9 @@ struct tlvitem
     size_t raw_value_length;// length of the value part, contains also possible terminating string
     size_t converted_value_len; // length of the converted_value
     char *converted_value;  // data after conversions etc, visible string
+    TYPE valuetype;         // type used in value conversion
+    size_t value_length;    // length of the value after length adjustment, without terminator
+    long long int int_value; // value of integer types, unsigned values are stored as is
     struct tldef *tl;       // pointer to tl-data, cannot be null
     struct tlvdef *tlv;     // pointer to tlv-data, can be null
 };
@@ -280,6 +301,18 @@ struct level
     FILE_OFFSET size;        // raw data size known to this level, will be decrement after every tlv read, when reaches 0, level is done
 };                           // size will get negative for indefinite levels, must be signed
 
+/* element handler, used by the library instead of printing */
+struct handler
+{
+    int (*element)(struct tlvitem *,void *);      // primitive element found, return non-zero to stop
+    int (*level_enter)(struct tlvitem *,void *);  // constructed element found
+    int (*level_exit)(int,void *);                // constructed element ended, level is the level of the element
+    void *data;                                   // user data given to handler functions
+};
+
+/* in-process decompressor, see decompress.c */
+struct decompressor;
+
 struct structure
 {
     char *name;             // Name of the structure
@@ -293,10 +326,34 @@ struct structure
     int hex_caps;           // print hexadecimal in capital letters
 };
 
+/* runtime statistics, see stats.c. Counters are always updated, times only when statistics are enabled */
+struct stats
+{
+    FILE_OFFSET bytes_read;          // octets read from input files
+    FILE_OFFSET elements[MAX_LEVEL + 1];  // elements parsed per level
+    FILE_OFFSET hash_hits;           // find_tlvdef found the tag in hash table
+    FILE_OFFSET hash_misses;         // tag was searched from the definition list
+    FILE_OFFSET flushes;             // buffer flushes
+    FILE_OFFSET bytes_moved;         // unread octets moved in buffer flushes
+    FILE_OFFSET iconv_conversions;   // character set conversions
+    FILE_OFFSET output_bytes;        // octets written to output
+    long long total_time;            // nanoseconds used in different phases
+    long long convert_time;
+    long long print_time;
+    long long io_time;               // reading input or waiting for the I/O thread
+};
+
+/* run statement s and add the time used to statistics field f */
+#define STATS_TIME(f,s) do { if(stats_enabled) { long long stats_start_ = stats_clock(); s; stats.f += stats_clock() - stats_start_; } else { s; } } while(0)
+
 
 #if defined (__STDC__) && __STDC__
-/* tlve.c prototypes */
+/* libtlve.c prototypes */
 void panic(char *,char *,char *);
+void data_error(char *,char *,char *);
+int data_error_is_caught();
+void data_error_catch(jmp_buf *);
+char *panic_message();
 
 /* xmalloc.c prototypes */
 VOID *xmalloc (size_t);
@@ -304,32 +361,70 @@ VOID *xcalloc (size_t, size_t);
 VOID *xrealloc (VOID *, size_t);
 char *xstrdup (char *);
 FILE * xfopen(char *, char *, char);
+FILE_OFFSET parse_size(char *);
 
 /* parse.rc prototypes */
 void parse_rc(char *, char *,char *);
+void free_rc();
 
 /* buffer.c prototypes */
 void set_input_file(char *);
+void set_input_memory(BUFFER *,size_t);
+void set_input_stream(FILE *,char *);
+void clear_input_files();
+void buffer_free();
 int open_next_input_file();
 int buffer(int, size_t);
-int get_buffer_state();
+unsigned long buffer_flush_count();
 int search_buffer_c(BUFFER,size_t);
 int search_buffer_s(BUFFER *,size_t,size_t);
 size_t buffer_unread();
 VOID buffer_read(size_t);
+FILE_OFFSET buffer_skip(FILE_OFFSET);
 BUFFER *buffer_data();
 char *get_current_file_name();
 FILE_OFFSET file_offset();
 FILE_OFFSET total_offset();
 int buffer_eof();
 void buffer_error(char *,struct tlvitem *);
+FILE_OFFSET buffer_error_offset();
+void buffer_capture(int);
+void buffer_capture_drop(FILE_OFFSET);
+BUFFER *buffer_captured(FILE_OFFSET,size_t *);
+int buffer_input_fd();
 void buffer_ahead();
 void buffer_back();
 int buffer_address_safe(BUFFER *);
+void set_input_file_skip(int);
+int get_current_file_index();
+void buffer_seek(FILE_OFFSET,FILE_OFFSET);
+void set_decompression(int);
+void set_preprocessors(int);
+void set_read_ahead(int);
+void set_batch_files(int);
+void input_progress(FILE_OFFSET *,FILE_OFFSET *);
 
 /* tlv.c prototypes */
 int get_current_level();
+void set_current_level(int);
+struct level *get_level(int);
+void execute_init();
+void execute_free();
 void execute();
+int execute_handler(struct handler *);
+void set_max_count(FILE_OFFSET);
+void set_max_total(FILE_OFFSET);
+void set_head(FILE_OFFSET);
+int execute_validate(FILE *);
+void execute_split();
+void set_resync(int);
+struct tlvdef *find_tlvdef(char *,TYPE);
+void convert_value(struct tlvitem *);
+int item_int_value(struct tlvitem *,long long int *);
+int cursor_start();
+struct tlvitem *cursor_next();
+int cursor_enter();
+int cursor_leave();
 
 /* print.c prototypes */
 void print_set_print_start_level(int);
@@ -338,10 +433,26 @@ void print_list_add_names(char *);
 void print_list_down(struct tlvitem *);
 void print_list_up();
 void print_list_add_item(struct tlvitem *);
+FILE_OFFSET print_list_selected();
+int print_list_block_level();
+void print_list_reset();
+void print_list_drop();
 void print_list_open_output(char *);
+void print_list_set_shard(char *);
+int print_list_is_template(char *);
+void print_list_file_output();
 void print_list_close_output();
+void print_list_add_output(char *);
+void print_list_open_outputs(int);
+void print_list_begin_query();
+void print_list_end_query();
+void print_list_use_print(char *);
+void print_list_check_primary();
+FILE *print_list_output();
+void print_primitive_item(struct tlvitem *,struct print *);
 void print_list_print();
 void print_list_add_expression(char *);
+void print_list_add_key_expression(char *);
 void print_file_header();
 void print_file_trailer();
 void print_list_check_names();
@@ -349,6 +460,14 @@ char *print_list_path();
 void print_init_path();
 void print_list_clear_hold();
 char *print_list_hex_dump(BUFFER *,size_t); 
+void print_list_push_path(char *);
+int print_list_path_level();
+char *print_list_path_name(int);
+void print_list_open_output_at(char *,FILE_OFFSET);
+FILE_OFFSET print_list_output_offset();
+int print_list_pending();
+struct tlvitem *print_list_open_constructor(int);
+void print_list_restore_constructor(struct tlvitem *);
 
 
 /* ber.c prototypes */
@@ -362,14 +481,98 @@ void format_oid(char *,BUFFER *, size_t);
 /* inconv.c prototypes */
 char *make_iconv(char *,char *,char *);
 
+/* decompress.c prototypes */
+int decompress_type(BUFFER *,size_t);
+struct decompressor *decompress_open(int,char *);
+void decompress_close(struct decompressor *);
+size_t decompress_read(struct decompressor *,BUFFER *,size_t,size_t (*)(void *,BUFFER *,size_t),void *);
+char *decompress_error(struct decompressor *);
+
+/* preproc.c prototypes */
+FILE *preproc_start(char *);
+
+/* batch.c prototypes */
+void batch_read(char **,BUFFER **,size_t *,int);
+
+/* stats.c prototypes */
+void stats_enable(char *);
+long long stats_clock();
+void stats_report();
+
+/* progress.c prototypes */
+void progress_set_interval(int);
+void progress_start();
+void progress_report();
+
+/* profile.c prototypes */
+void profile_defs_enable();
+void profile_init();
+void profile_element(struct tlvitem *,long long);
+void profile_convert(struct tlvitem *,long long);
+void profile_print_start();
+void profile_print_end(struct tlvitem *,struct print *);
+void profile_report();
+void profile_tree_enable();
+void profile_tree_add(struct tlvitem *);
+void profile_tree_report(FILE *);
+
+/* aggregate.c prototypes */
+void aggregate_set_record(char *);
+void aggregate_set_keys(char *);
+void aggregate_set_functions(char *);
+void aggregate_init();
+void aggregate_item(struct tlvitem *);
+void aggregate_level(int);
+void aggregate_report(FILE *);
+
+/* keyset.c prototypes */
+struct keyset *keyset_load(char *);
+int keyset_match(struct keyset *,char *);
+
+/* matcher.c prototypes */
+struct matcher *matcher_new();
+int matcher_add(struct matcher *,char *,int *);
+void matcher_compile(struct matcher *);
+void matcher_scan(struct matcher *,char *);
+
+/* raw.c prototypes */
+void raw_enable();
+void raw_file_start();
+void raw_item(struct tlvitem *);
+void raw_write_block();
+void raw_flush();
+void raw_block_done();
+void raw_set_split_size(FILE_OFFSET);
+void raw_set_split_records(FILE_OFFSET);
+void raw_split_start(char *);
+void raw_split_block(FILE_OFFSET);
+void raw_split_end();
+
+/* query.c prototypes */
+void query_load(char *);
+
+/* sketch.c prototypes */
+void sketch_add_top(char *);
+void sketch_add_distinct(char *);
+void sketch_set_per_file();
+void sketch_init();
+void sketch_item(struct tlvitem *);
+void sketch_file_end();
+void sketch_report(FILE *);
+
+/* checkpoint.c prototypes */
+void checkpoint_set_file(char *);
+void checkpoint_set_interval(FILE_OFFSET);
+FILE_OFFSET checkpoint_load();
+int checkpoint_restore();
+void checkpoint_check();
+void checkpoint_done();
+
 
 
 #endif
 
 /* buffer.c values */
-#define S_BUFFER_OK 0
-#define S_BUFFER_STALE 1
-
 #define B_INIT 0
 #define B_DESIRED 1
 #define B_NEEDED 2
@@ -377,22 +580,40 @@ char *make_iconv(char *,char *,char *);
 #define B_PRINTED 4
 #define B_FLUSH_FORCE 5
 
+/* decompress.c values */
+#define D_NONE 0
+#define D_GZIP 1
+#define D_BZIP2 2
+#define D_ZSTD 3
+
+/* batch.c values */
+#define BATCH_MAX_FILES 64      // maximum number of files read in one batch
+
 
 
 /* Global data */
 #define FIRST_LEVEL 1
-extern struct structure structure;
-extern struct tldef *tl;
-extern struct print *print;
-extern struct hold *hold;
-extern struct type_mappings *type_maps;
-extern int debug;
-extern int expression_and;
-extern char *codeset;
+extern TLS struct structure structure;
+extern TLS struct tldef *tl;
+extern TLS struct print *print;
+extern TLS struct hold *hold;
+extern TLS struct type_mappings *type_maps;
+extern TLS int debug;
+extern TLS int expression_and;
+extern TLS char *codeset;
+extern TLS struct stats stats;
+extern TLS int stats_enabled;
+extern volatile sig_atomic_t progress_requested;
+extern TLS int profile_enabled;
+extern TLS int profile_tree;
+extern TLS int aggregating;
+extern TLS int sketching;
+extern TLS int raw_output;
+extern TLS int splitting;
 
 extern char *program_name;
 extern char *version;
 extern char *host;
 extern char *build_date;
 extern char *email_address;
-extern char *tlve_open;
+extern TLS char *tlve_open;
@@ -121,3 +121,28 @@ xfopen(char *name, char *mode, char bin_asc)
    return ret;
 }
 
+/* parse size given as number with optional suffix K, M or G
+ */
+FILE_OFFSET
+parse_size(char *size)
+{
+    FILE_OFFSET ret;
+    char *end;
+
+    ret = (FILE_OFFSET) strtoll(size,&end,10);
+
+    switch(toupper(*end))
+    {
+        case 'G':
+            ret *= (FILE_OFFSET) 1024;
+        case 'M':
+            ret *= (FILE_OFFSET) 1024;
+        case 'K':
+            ret *= (FILE_OFFSET) 1024;
+            end++;
+            break;
+    }
+
+    if(end == size || *end) panic("Invalid size",size,NULL);
+    return ret;
+}